@@ -0,0 +1,213 @@
+/* hpc_benchgen: generate a synthetic benchmark: sampled profile HMMs of varied length and a target database
+ * with a chosen length distribution, some of whose targets are planted homologs emitted from those models.
+ * The same seed always gives the same files, so timings from different versions are of the same work.
+ *
+ *   <prefix>.hmm    calibrated models, ready for hmmsearch and hpc_hmmsearch
+ *   <prefix>.fa     target sequences, FASTA
+ *   <prefix>.truth  each planted target and the model it came from
+ *   <prefix>.info   sizes of the set, as shell variable assignments
+ *
+ * Build it in hmmer's src/ directory next to hpc_hmmsearch, with the same compile and link lines (no openmp needed):
+cc -O3 -fPIC -DHAVE_CONFIG_H -I../easel -I../libdivsufsort -I../easel -I. -I. -o hpc_benchgen.o -c hpc_benchgen.c
+cc -O3 -fPIC -DHAVE_CONFIG_H -L../easel -L./impl_sse -L../libdivsufsort -L. -o hpc_benchgen hpc_benchgen.o -lhmmer -leasel -ldivsufsort -lm
+ */
+
+#include "p7_config.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_getopts.h"
+#include "esl_random.h"
+#include "esl_randomseq.h"
+#include "esl_sq.h"
+#include "esl_sqio.h"
+
+#include "hmmer.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type          default   env  range     toggles   reqs   incomp              help                                                         docgroup*/
+  { "-h",           eslARG_NONE,     FALSE, NULL, NULL,    NULL,  NULL,  NULL,            "show brief help on version and usage",                            1 },
+  { "--seed",       eslARG_INT,       "42", NULL, "n>=1",  NULL,  NULL,  NULL,            "random number seed",                                              1 },
+  { "--nhmm",       eslARG_INT,      "100", NULL, "n>=1",  NULL,  NULL,  NULL,            "number of models",                                                1 },
+  { "--Mmin",       eslARG_INT,       "50", NULL, "n>=1",  NULL,  NULL,  NULL,            "shortest model; lengths are log-uniform in [Mmin,Mmax]",          1 },
+  { "--Mmax",       eslARG_INT,      "800", NULL, "n>=1",  NULL,  NULL,  NULL,            "longest model",                                                   1 },
+  { "--nseq",       eslARG_INT,   "100000", NULL, "n>=1",  NULL,  NULL,  NULL,            "number of target sequences",                                      1 },
+  { "--lendist",    eslARG_STRING, "lognormal", NULL, NULL, NULL, NULL,  NULL,            "target lengths: fixed, uniform or lognormal",                     1 },
+  { "--Lmean",      eslARG_INT,      "350", NULL, "n>=1",  NULL,  NULL,  NULL,            "mean target length (fixed and lognormal)",                        1 },
+  { "--Lsd",        eslARG_INT,      "250", NULL, "n>=0",  NULL,  NULL,  NULL,            "standard deviation of target length (lognormal)",                 1 },
+  { "--Lmin",       eslARG_INT,       "20", NULL, "n>=1",  NULL,  NULL,  NULL,            "shortest background target",                                      1 },
+  { "--Lmax",       eslARG_INT,    "10000", NULL, "n>=1",  NULL,  NULL,  NULL,            "longest background target",                                       1 },
+  { "--homologs",   eslARG_REAL,    "0.01", NULL, "0<=x<=1", NULL, NULL, NULL,            "fraction of targets emitted from one of the models",              1 },
+  { "--nocalib",    eslARG_NONE,     FALSE, NULL, NULL,    NULL,  NULL,  NULL,            "don't calibrate E-value parameters (faster, not hmmsearch-ready)", 1 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+
+static char usage[]  = "[options] <prefix>";
+static char banner[] = "generate synthetic models and targets for benchmarking hpc_hmmsearch";
+
+enum { LEN_FIXED, LEN_UNIFORM, LEN_LOGNORMAL };
+
+//a background target length. lognormal is parameterized by the mean and sd of the length itself
+static int sample_length(ESL_RANDOMNESS *r, int dist, int Lmean, int Lsd, int Lmin, int Lmax)
+{
+  double s2, mu, L;
+
+  switch (dist)
+  {
+    case LEN_FIXED:   return Lmean;
+    case LEN_UNIFORM: return Lmin + esl_rnd_Roll(r, Lmax - Lmin + 1);
+    default:
+      s2 = log(1. + ((double) Lsd * Lsd) / ((double) Lmean * Lmean));
+      mu = log((double) Lmean) - s2 / 2.;
+      L  = exp(esl_rnd_Gaussian(r, mu, sqrt(s2)));
+      if (L < Lmin) L = Lmin;
+      if (L > Lmax) L = Lmax;
+      return (int) L;
+  }
+}
+
+static FILE *open_out(const char *prefix, const char *suffix)
+{
+  char *name = NULL;
+  FILE *fp;
+
+  if (esl_sprintf(&name, "%s.%s", prefix, suffix) != eslOK) p7_Fail("Failed to allocate a file name\n");
+  if ((fp = fopen(name, "w")) == NULL) p7_Fail("Failed to open %s for writing\n", name);
+  free(name);
+  return fp;
+}
+
+int main(int argc, char **argv)
+{
+  ESL_GETOPTS     *go      = esl_getopts_Create(options);
+  ESL_RANDOMNESS  *r       = NULL;
+  ESL_ALPHABET    *abc     = NULL;
+  P7_BG           *bg      = NULL;
+  P7_PROFILE      *gm      = NULL;
+  P7_HMM         **hmm     = NULL;
+  ESL_SQ          *sq      = NULL;
+  FILE            *hfp, *sfp, *tfp, *ifp;
+  char            *prefix;
+  char             name[32];
+  int              nhmm, nseq, Mmin, Mmax, Lmean, Lsd, Lmin, Lmax;
+  int              dist    = LEN_LOGNORMAL;
+  double           homologs;
+  int64_t          sum_M = 0, nres = 0;
+  int              nplanted = 0;
+  int              i, h, L, M;
+
+  if (esl_opt_ProcessCmdline(go, argc, argv) != eslOK || esl_opt_VerifyConfig(go) != eslOK)
+  {
+    printf("Failed to parse command line: %s\n", go->errbuf);
+    esl_usage(stdout, argv[0], usage);
+    exit(1);
+  }
+  if (esl_opt_GetBoolean(go, "-h") == TRUE)
+  {
+    p7_banner(stdout, argv[0], banner);
+    esl_usage(stdout, argv[0], usage);
+    puts("\nOptions:");
+    esl_opt_DisplayHelp(stdout, go, 1, 2, 80);
+    exit(0);
+  }
+  if (esl_opt_ArgNumber(go) != 1) { puts("Incorrect number of command line arguments."); esl_usage(stdout, argv[0], usage); exit(1); }
+
+  prefix   = esl_opt_GetArg(go, 1);
+  nhmm     = esl_opt_GetInteger(go, "--nhmm");
+  nseq     = esl_opt_GetInteger(go, "--nseq");
+  Mmin     = esl_opt_GetInteger(go, "--Mmin");
+  Mmax     = esl_opt_GetInteger(go, "--Mmax");
+  Lmean    = esl_opt_GetInteger(go, "--Lmean");
+  Lsd      = esl_opt_GetInteger(go, "--Lsd");
+  Lmin     = esl_opt_GetInteger(go, "--Lmin");
+  Lmax     = esl_opt_GetInteger(go, "--Lmax");
+  homologs = esl_opt_GetReal(go, "--homologs");
+  if (Mmax < Mmin) p7_Fail("--Mmax must be at least --Mmin\n");
+  if (Lmax < Lmin) p7_Fail("--Lmax must be at least --Lmin\n");
+
+  if      (strcmp(esl_opt_GetString(go, "--lendist"), "fixed")     == 0) dist = LEN_FIXED;
+  else if (strcmp(esl_opt_GetString(go, "--lendist"), "uniform")   == 0) dist = LEN_UNIFORM;
+  else if (strcmp(esl_opt_GetString(go, "--lendist"), "lognormal") == 0) dist = LEN_LOGNORMAL;
+  else p7_Fail("--lendist must be fixed, uniform or lognormal\n");
+
+  r   = esl_randomness_Create(esl_opt_GetInteger(go, "--seed"));
+  abc = esl_alphabet_Create(eslAMINO);
+  bg  = p7_bg_Create(abc);
+  gm  = p7_profile_Create(Mmax, abc);
+  sq  = esl_sq_CreateDigital(abc);
+  if ((hmm = malloc(sizeof(P7_HMM *) * nhmm)) == NULL) goto ERROR;
+
+  hfp = open_out(prefix, "hmm");
+  sfp = open_out(prefix, "fa");
+  tfp = open_out(prefix, "truth");
+  ifp = open_out(prefix, "info");
+
+  //models: lengths log-uniform, so short and long models are equally represented
+  for (h = 0; h < nhmm; h++)
+  {
+    M = (int) floor(Mmin * exp(esl_random(r) * log((double) (Mmax + 1) / Mmin)));
+    if (M > Mmax) M = Mmax;
+    if (p7_modelsample(r, M, abc, &hmm[h]) != eslOK) p7_Fail("Failed to sample model %d\n", h);
+    snprintf(name, sizeof(name), "bench%05d", h);
+    p7_hmm_SetName(hmm[h], name);
+    p7_hmm_SetCtime(hmm[h]);
+    p7_hmm_SetConsensus(hmm[h], NULL);
+    p7_hmm_SetComposition(hmm[h]);
+    if (! esl_opt_GetBoolean(go, "--nocalib") && p7_Calibrate(hmm[h], NULL, &r, &bg, NULL, NULL) != eslOK)
+      p7_Fail("Failed to calibrate model %d\n", h);
+    if (p7_hmmfile_WriteASCII(hfp, -1, hmm[h]) != eslOK) p7_Fail("Failed to write %s.hmm\n", prefix);
+    sum_M += M;
+  }
+
+  //targets: i.i.d. background residues, or with probability --homologs one local hit to a random model
+  //with background flanks, as hmmsearch's null model expects
+  for (i = 0; i < nseq; i++)
+  {
+    esl_sq_Reuse(sq);
+    L = sample_length(r, dist, Lmean, Lsd, Lmin, Lmax);
+    if (esl_random(r) < homologs)
+    {
+      h = esl_rnd_Roll(r, nhmm);
+      p7_ProfileConfig(hmm[h], bg, gm, L, p7_UNILOCAL);
+      if (p7_ProfileEmit(r, hmm[h], gm, bg, sq, NULL) != eslOK) p7_Fail("Failed to emit from model %d\n", h);
+      esl_sq_FormatName(sq, "seq%08d", i);
+      esl_sq_SetDesc(sq, "planted");
+      fprintf(tfp, "%s\t%s\n", sq->name, hmm[h]->name);
+      nplanted++;
+    }
+    else
+    {
+      esl_sq_GrowTo(sq, L);
+      esl_rsq_xfIID(r, bg->f, abc->K, L, sq->dsq);
+      sq->n = L;
+      esl_sq_FormatName(sq, "seq%08d", i);
+    }
+    if (esl_sqio_Write(sfp, sq, eslSQFILE_FASTA, FALSE) != eslOK) p7_Fail("Failed to write %s.fa\n", prefix);
+    nres += sq->n;
+  }
+
+  fprintf(ifp, "nhmm=%d\nsum_M=%lld\nnseq=%d\nnres=%lld\nplanted=%d\nseed=%d\n",
+          nhmm, (long long) sum_M, nseq, (long long) nres, nplanted, esl_opt_GetInteger(go, "--seed"));
+  if (fclose(hfp) != 0 || fclose(sfp) != 0 || fclose(tfp) != 0 || fclose(ifp) != 0) p7_Fail("Failed to close the output of %s\n", prefix);
+  printf("%s: %d models (sum of M %lld), %d targets, %lld residues, %d planted\n",
+         prefix, nhmm, (long long) sum_M, nseq, (long long) nres, nplanted);
+
+  for (h = 0; h < nhmm; h++) p7_hmm_Destroy(hmm[h]);
+  free(hmm);
+  esl_sq_Destroy(sq);
+  p7_profile_Destroy(gm);
+  p7_bg_Destroy(bg);
+  esl_alphabet_Destroy(abc);
+  esl_randomness_Destroy(r);
+  esl_getopts_Destroy(go);
+  return 0;
+
+ERROR:
+  p7_Fail("Failed to allocate the model table\n");
+  return 1;
+}
@@ -0,0 +1,135 @@
+#!/usr/bin/env bash
+# run_bench.sh: time hpc_hmmsearch on synthetic data over a sweep of --cpu, --seq_buffer and --hmm_buffer,
+# check its tables against stock hmmsearch, and append one JSON object per run to a results file.
+#
+#   run_bench.sh [-o results.jsonl] [-w workdir] [-l label] [dataset ...]
+#
+# datasets are named below; the default is all of them. Settings come from the environment:
+#
+#   HPC_HMMSEARCH  hpc_hmmsearch binary                      [hpc_hmmsearch on PATH]
+#   HMMSEARCH      stock hmmsearch to compare against         [hmmsearch on PATH]
+#   HPC_BENCHGEN   generator                                  [hpc_benchgen on PATH]
+#   CPUS           --cpu values                               ["1 2 4 8"]
+#   SEQ_BUFFERS    --seq_buffer values                        ["20000 200000"]
+#   HMM_BUFFERS    --hmm_buffer values                        ["50 500"]
+#   REPEATS        runs of each configuration                 [1]
+#   EXTRA          further hpc_hmmsearch options, e.g. "--sched split"
+#   STOCK_TIMING   set to 0 to run stock hmmsearch once only, for the check, instead of at every --cpu
+#
+# Generated data is kept in the work directory and reused: the generator is seeded, so it is the same data every
+# time. Wall time and peak RSS come from GNU time. cells is sum of M x residues, the work of one full search.
+
+set -u
+
+results=bench_results.jsonl
+work=bench_data
+label=$(git -C "$(dirname "$0")" describe --always --dirty 2>/dev/null || echo unknown)
+
+while getopts "o:w:l:h" opt; do
+  case $opt in
+    o) results=$OPTARG ;;
+    w) work=$OPTARG ;;
+    l) label=$OPTARG ;;
+    *) sed -n '2,21p' "$0" | sed 's/^# \{0,1\}//'; exit 1 ;;
+  esac
+done
+shift $((OPTIND - 1))
+
+HPC_HMMSEARCH=${HPC_HMMSEARCH:-hpc_hmmsearch}
+HMMSEARCH=${HMMSEARCH:-hmmsearch}
+HPC_BENCHGEN=${HPC_BENCHGEN:-hpc_benchgen}
+CPUS=${CPUS:-"1 2 4 8"}
+SEQ_BUFFERS=${SEQ_BUFFERS:-"20000 200000"}
+HMM_BUFFERS=${HMM_BUFFERS:-"50 500"}
+REPEATS=${REPEATS:-1}
+EXTRA=${EXTRA:-}
+STOCK_TIMING=${STOCK_TIMING:-1}
+
+# name and generator options of each dataset
+declare -A DATASET=(
+  [short]="--seed 1 --nhmm 200 --Mmin 50  --Mmax 400  --nseq 200000 --lendist lognormal --Lmean 250  --Lsd 150"
+  [long]="--seed 2  --nhmm 50  --Mmin 300 --Mmax 2000 --nseq 20000  --lendist lognormal --Lmean 1500 --Lsd 1500 --Lmax 35000"
+  [skewed]="--seed 3 --nhmm 100 --Mmin 20 --Mmax 2500 --nseq 100000 --lendist uniform --Lmin 20 --Lmax 5000"
+  [fixed]="--seed 4  --nhmm 100 --Mmin 200 --Mmax 200 --nseq 100000 --lendist fixed --Lmean 350"
+)
+
+TIME=$(command -v gtime || echo /usr/bin/time)
+if ! "$TIME" -f %M true >/dev/null 2>&1; then
+  echo "run_bench.sh: needs GNU time (for peak RSS) at /usr/bin/time or gtime" >&2
+  exit 1
+fi
+for b in "$HPC_HMMSEARCH" "$HMMSEARCH" "$HPC_BENCHGEN"; do
+  command -v "$b" >/dev/null || { echo "run_bench.sh: $b not found" >&2; exit 1; }
+done
+
+[ $# -gt 0 ] && sets="$*" || sets="${!DATASET[*]}"
+mkdir -p "$work"
+host=$(hostname)
+date=$(date -u +%Y-%m-%dT%H:%M:%SZ)
+
+# hit tables without their comment lines, which name the program, options and date
+table() { grep -v '^#' "$1"; }
+
+# run <tag> <cmd...>: time a search; sets wall and rss
+run() {
+  local tag=$1; shift
+  if ! "$TIME" -f "%e %M" -o "$work/$tag.time" "$@" > /dev/null 2> "$work/$tag.err"; then
+    echo "run_bench.sh: failed: $*" >&2
+    cat "$work/$tag.err" >&2
+    exit 1
+  fi
+  read -r wall rss < <(tail -n 1 "$work/$tag.time")
+}
+
+# record <dataset> <program> <cpu> <seq_buffer> <hmm_buffer> <rep> <match>
+record() {
+  awk -v label="$label" -v host="$host" -v date="$date" -v ds="$1" -v prog="$2" -v cpu="$3" -v sb="$4" -v hb="$5" \
+      -v rep="$6" -v same="$7" -v wall="$wall" -v rss="$rss" -v cells="$cells" -v nres="$nres" -v extra="$EXTRA" 'BEGIN {
+    gcups = (wall > 0) ? cells / wall / 1e9 : 0
+    printf "{\"label\": \"%s\", \"host\": \"%s\", \"date\": \"%s\", \"dataset\": \"%s\", \"program\": \"%s\", \"cpu\": %d, ", label, host, date, ds, prog, cpu
+    printf "\"seq_buffer\": %s, \"hmm_buffer\": %s, \"extra\": \"%s\", \"rep\": %d, \"wall_s\": %.2f, \"max_rss_kb\": %d, ", sb, hb, extra, rep, wall, rss
+    printf "\"cells\": %.0f, \"gcups\": %.3f, \"mres_per_s\": %.3f, \"match\": %s}\n", cells, gcups, (wall > 0) ? nres / wall / 1e6 : 0, same
+  }' >> "$results"
+}
+
+for ds in $sets; do
+  [ -n "${DATASET[$ds]+x}" ] || { echo "run_bench.sh: no dataset $ds (have ${!DATASET[*]})" >&2; exit 1; }
+  prefix=$work/$ds
+  if [ ! -s "$prefix.info" ]; then
+    echo "generating $ds" >&2
+    "$HPC_BENCHGEN" ${DATASET[$ds]} "$prefix" >&2 || exit 1
+  fi
+  . "$prefix.info"
+  cells=$(awk -v m="$sum_M" -v r="$nres" 'BEGIN { printf "%.0f", m * r }')
+
+  # the reference tables; stock --cpu counts worker threads on top of the master, so n-1 of them uses n
+  for cpu in $CPUS; do
+    if [ ! -s "$prefix.ref.tbl" ] || [ "$STOCK_TIMING" != 0 ]; then
+      for rep in $(seq 1 "$REPEATS"); do
+        run "$ds.stock" "$HMMSEARCH" --cpu $((cpu - 1)) --tblout "$prefix.ref.tbl" --domtblout "$prefix.ref.domtbl" \
+            -o /dev/null "$prefix.hmm" "$prefix.fa"
+        record "$ds" hmmsearch "$cpu" null null "$rep" true
+        echo "$ds hmmsearch cpu=$cpu: ${wall}s ${rss}kB" >&2
+      done
+    fi
+  done
+
+  for cpu in $CPUS; do
+    for sb in $SEQ_BUFFERS; do
+      for hb in $HMM_BUFFERS; do
+        for rep in $(seq 1 "$REPEATS"); do
+          run "$ds.hpc" "$HPC_HMMSEARCH" --cpu "$cpu" --seq_buffer "$sb" --hmm_buffer "$hb" $EXTRA \
+              --tblout "$prefix.tbl" --domtblout "$prefix.domtbl" -o /dev/null "$prefix.hmm" "$prefix.fa"
+          if cmp -s <(table "$prefix.tbl") <(table "$prefix.ref.tbl") && cmp -s <(table "$prefix.domtbl") <(table "$prefix.ref.domtbl"); then
+            match=true
+          else
+            match=false
+            echo "run_bench.sh: $ds cpu=$cpu seq_buffer=$sb hmm_buffer=$hb: tables differ from hmmsearch" >&2
+          fi
+          record "$ds" hpc_hmmsearch "$cpu" "$sb" "$hb" "$rep" $match
+          echo "$ds hpc_hmmsearch cpu=$cpu seq_buffer=$sb hmm_buffer=$hb: ${wall}s ${rss}kB match=$match" >&2
+        done
+      done
+    done
+  done
+done
@@ -0,0 +1,165 @@
+/* hpc_hmmclient: send query HMMs to an hpc_hmmsearch --daemon over its UNIX socket, and write
+ * back the outputs it returns, the way hpc_hmmsearch would have written them itself.
+ *
+ * Build it next to hpc_hmmsearch, with the same compile and link lines (no openmp needed):
+cc -O3 -fPIC -DHAVE_CONFIG_H -I../easel -I../libdivsufsort -I../easel -I. -I. -o hpc_hmmclient.o -c hpc_hmmclient.c
+cc -O3 -fPIC -DHAVE_CONFIG_H -L../easel -L./impl_sse -L../libdivsufsort -L. -o hpc_hmmclient hpc_hmmclient.o -lhmmer -leasel -ldivsufsort -lm
+ */
+
+#include "p7_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "easel.h"
+#include "esl_getopts.h"
+
+#include "hmmer.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type            default  env  range  toggles  reqs   incomp                         help                                                docgroup*/
+  { "-h",           eslARG_NONE,     FALSE, NULL, NULL,  NULL,    NULL,  NULL,                          "show brief help on version and usage",                    1 },
+  { "-o",           eslARG_OUTFILE,   NULL, NULL, NULL,  NULL,    NULL,  "--quit",                      "direct output to file <f>, not stdout",                   1 },
+  { "--tblout",     eslARG_OUTFILE,   NULL, NULL, NULL,  NULL,    NULL,  "--quit",                      "save parseable table of per-sequence hits to file <f>",   1 },
+  { "--domtblout",  eslARG_OUTFILE,   NULL, NULL, NULL,  NULL,    NULL,  "--quit",                      "save parseable table of per-domain hits to file <f>",     1 },
+  { "--quit",       eslARG_NONE,     FALSE, NULL, NULL,  NULL,    NULL,  NULL,                          "stop the daemon instead; no <hmmfile>",                   1 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+
+static char usage[]  = "[options] <socket> <hmmfile>";
+static char banner[] = "search query HMMs against the database of an hpc_hmmsearch --daemon";
+
+static void write_all(int fd, const char *buf, size_t n)
+{
+  ssize_t w;
+
+  while (n > 0)
+  {
+    if ((w = write(fd, buf, n)) < 0) { if (errno == EINTR) continue; p7_Fail("Failed to send the request: %s\n", strerror(errno)); }
+    buf += w;
+    n   -= w;
+  }
+}
+
+//the next <n> bytes of the reply, or the rest of a line when <line> is set
+static size_t read_reply(int fd, char *buf, size_t n, int line)
+{
+  size_t  got = 0;
+  ssize_t r;
+
+  while (got < n)
+  {
+    if ((r = read(fd, buf + got, line ? 1 : n - got)) < 0) { if (errno == EINTR) continue; p7_Fail("Failed to read the reply: %s\n", strerror(errno)); }
+    if (r == 0) p7_Fail("The daemon closed the connection before it finished replying\n");
+    got += r;
+    if (line && buf[got - 1] == '\n') { buf[got - 1] = '\0'; return got; }
+  }
+  if (line) p7_Fail("Reply line too long\n");
+  return got;
+}
+
+//the whole of a file, or of stdin for "-"
+static char *slurp(const char *filename, size_t *ret_n)
+{
+  FILE   *fp = strcmp(filename, "-") == 0 ? stdin : fopen(filename, "rb");
+  char   *buf = NULL;
+  size_t  n = 0, nalloc = 0, r;
+
+  if (fp == NULL) p7_Fail("Failed to open HMM file %s for reading\n", filename);
+  do {
+    if (n == nalloc) { nalloc = nalloc ? 2 * nalloc : 1 << 20; if ((buf = realloc(buf, nalloc)) == NULL) goto ERROR; }
+    r  = fread(buf + n, 1, nalloc - n, fp);
+    n += r;
+  } while (r > 0);
+  if (ferror(fp)) p7_Fail("Failed to read HMM file %s\n", filename);
+  if (fp != stdin) fclose(fp);
+  *ret_n = n;
+  return buf;
+
+ERROR:
+  p7_Fail("Failed to allocate %zu bytes for HMM file %s\n", nalloc, filename);
+  return NULL;
+}
+
+int main(int argc, char **argv)
+{
+  ESL_GETOPTS        *go   = esl_getopts_Create(options);
+  struct sockaddr_un  addr;
+  char                line[256];
+  char                name[16];
+  char               *opt;
+  char               *req  = NULL;
+  char               *buf  = NULL;
+  size_t              nreq = 0, n, nalloc = 0;
+  FILE               *fp;
+  int                 fd;
+
+  if (esl_opt_ProcessCmdline(go, argc, argv) != eslOK || esl_opt_VerifyConfig(go) != eslOK)
+  {
+    printf("Failed to parse command line: %s\n", go->errbuf);
+    esl_usage(stdout, argv[0], usage);
+    exit(1);
+  }
+  if (esl_opt_GetBoolean(go, "-h") == TRUE)
+  {
+    p7_banner(stdout, argv[0], banner);
+    esl_usage(stdout, argv[0], usage);
+    puts("\nOptions:");
+    esl_opt_DisplayHelp(stdout, go, 1, 2, 80);
+    exit(0);
+  }
+  if (esl_opt_ArgNumber(go) != (esl_opt_GetBoolean(go, "--quit") ? 1 : 2)) { puts("Incorrect number of command line arguments."); esl_usage(stdout, argv[0], usage); exit(1); }
+
+  if (! esl_opt_GetBoolean(go, "--quit")) req = slurp(esl_opt_GetArg(go, 2), &nreq);
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(esl_opt_GetArg(go, 1)) >= sizeof(addr.sun_path)) p7_Fail("Socket path %s is too long\n", esl_opt_GetArg(go, 1));
+  strcpy(addr.sun_path, esl_opt_GetArg(go, 1));
+  if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 || connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0)
+    p7_Fail("Failed to connect to a daemon on %s: %s\n", esl_opt_GetArg(go, 1), strerror(errno));
+
+  if (req)
+  {
+    snprintf(line, sizeof(line), "SEARCH %zu\n", nreq);
+    write_all(fd, line, strlen(line));
+    write_all(fd, req, nreq);
+  }
+  else write_all(fd, "QUIT\n", 5);
+
+  //the reply is sections of "<name> <n>\n" and <n> bytes, then END, or a single ERR line
+  while (read_reply(fd, line, sizeof(line), TRUE), strcmp(line, "END") != 0)
+  {
+    if (strncmp(line, "ERR ", 4) == 0) p7_Fail("The daemon refused the search: %s\n", line + 4);
+    if (sscanf(line, "%15s %zu", name, &n) != 2) p7_Fail("Unexpected reply from the daemon: %s\n", line);
+    if (n > nalloc) { nalloc = n; if ((buf = realloc(buf, nalloc)) == NULL) goto ERROR; }
+    read_reply(fd, buf, n, FALSE);
+
+    if      (strcmp(name, "OUT")    == 0) opt = "-o";
+    else if (strcmp(name, "TBL")    == 0) opt = "--tblout";
+    else if (strcmp(name, "DOMTBL") == 0) opt = "--domtblout";
+    else continue;   //an output this client doesn't know about
+
+    //the main output goes to stdout unless -o says otherwise; the tables only where asked for
+    if      (esl_opt_IsOn(go, opt)) { if ((fp = fopen(esl_opt_GetString(go, opt), "w")) == NULL) p7_Fail("Failed to open %s for writing\n", esl_opt_GetString(go, opt)); }
+    else if (strcmp(opt, "-o") == 0) fp = stdout;
+    else continue;
+    if (fwrite(buf, 1, n, fp) != n) p7_Fail("Failed to write the %s output\n", name);
+    if (fp != stdout) fclose(fp);
+  }
+
+  close(fd);
+  free(buf);
+  free(req);
+  esl_getopts_Destroy(go);
+  return 0;
+
+ERROR:
+  p7_Fail("Failed to allocate %zu bytes for the reply\n", n);
+  return 1;
+}
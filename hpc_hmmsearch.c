@@ -15,6 +15,50 @@ cc -openmp -O3 -ansi_alias  -fPIC  -DHAVE_CONFIG_H  -L../easel -L./impl_sse -L..
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <math.h>
+#include <limits.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <signal.h>
+
+#include <omp.h>
+
+#ifdef HAVE_MPI
+#include "mpi.h"
+#endif
+
+#ifdef HAVE_LIBNUMA
+#include <numa.h>
+#endif
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+//the batched MSV filter is built for SSSE3, AVX2 and (with gcc 6 or newer) AVX-512 via target attributes,
+//whatever -march says, and the widest one the CPU supports is picked at run time
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HAVE_MSV_BATCH
+#if !defined(__clang__) && __GNUC__ >= 6
+#define HAVE_MSV_AVX512
+#endif
+#endif
 
 #include "easel.h"
 #include "esl_alphabet.h"
@@ -23,22 +67,163 @@ cc -openmp -O3 -ansi_alias  -fPIC  -DHAVE_CONFIG_H  -L../easel -L./impl_sse -L..
 #include "esl_msafile.h"
 #include "esl_sq.h"
 #include "esl_sqio.h"
+#include "esl_ssi.h"
 
 #include "hmmer.h"
 
+#include "hpc_seqdb.h"
+
 //a global variable tracking how many work units remain.
 //if it's less than the number of threads then we've become unbalanced 
 //and we should consider subdividing work that remains
+//(only --sched split balances this way now; the default tile scheduler plans the split up front)
 int work_counter;
 
+//instruction sets of the batched filter kernels, narrowest first
+enum { SIMD_NONE = 0, SIMD_SSE, SIMD_AVX2, SIMD_AVX512 };
+static const char *simd_name[] = { "none", "sse", "avx2", "avx512" };
+
+//the kernels in use, picked once in main from the CPU and --simd
+int simd_level;
+
+//the counters of a pipeline that p7_pipeline_Merge adds up
+typedef struct
+{
+  uint64_t nseqs, nres;
+  uint64_t n_past_msv,   n_past_bias,   n_past_vit,   n_past_fwd,   n_output;
+  uint64_t pos_past_msv, pos_past_bias, pos_past_vit, pos_past_fwd, pos_output;
+} PLI_COUNTS;
+
+//--top_k: the k best sort keys of one model's hits so far, a min-heap shared by all of its work units.
+//a hit whose key is below the kth has k hits ranked strictly above it, all reported if it is, so it can't
+//be in the output; it keeps its score for the counts and thresholds and loses its domains
+typedef struct
+{
+  omp_lock_t  lock;
+  double     *heap;
+  int         k, n;
+  double      bound;   //heap[0] once the heap is full, -infinity before; read without the lock
+} TOPK;
+
 typedef struct
 {
   P7_BG *bg;
   P7_OPROFILE *om;
   P7_PIPELINE *pli;
   P7_TOPHITS *th;
+
+  //work units leave their results here, one slot per thread, and output_hmm_buffer
+  //combines them into th and pli. no locking while the buffer is being searched
+  P7_TOPHITS **th_part;
+  PLI_COUNTS  *cnt_part;
+
+  //--numa: a copy of om on each node, made by the first thread there that searches with it
+  P7_OPROFILE **om_node;
+  int           nnodes;
+
+  int           trace_name;   //--trace: the model's name in the trace, -1 until its first kernel
+
+  TOPK         *topk;         //--top_k, NULL without it
 } HMM_BUFFER;
 
+//per-thread reusable work unit state, see work_state_Get
+typedef struct work_pool_s WORK_POOL;
+
+//how a work block (hmm buffer x sequence buffer) is divided between threads, see run_work_block
+enum { SCHED_TILES = 0, SCHED_SPLIT };
+
+typedef struct tile_sched_s TILE_SCHED;
+
+//--numa: threads are dealt to the nodes in blocks and pinned there. every sequence buffer is cut into
+//one slice per node, proportional to its threads, and that slice's memory is first touched by them.
+//tiles of a slice go to its node's threads first
+typedef struct
+{
+  int      nnodes;
+  int     *id;       //system node number of each node used
+  int     *node;     //node of each thread
+  int     *first;    //threads first[k]..first[k+1]-1 are on node k
+  int64_t *local;    //per thread: residues x model positions of the tiles the scheduler gave it from its own
+  int64_t *remote;   //node's slices, and from others'. this is where work was sent, not where memory is
+  int64_t *seq_local, *seq_remote;   //per thread: sampled pages of targets it read on its node, and elsewhere
+  int64_t *om_local,  *om_remote;    //and the same for the profile copies it searched with
+} NUMA_INFO;
+
+//--stats: where the time went. every thread adds to its own row, so nothing is shared until the report.
+//the busy stages are the ones that count toward a thread's busy time; output spans merge and format on the
+//thread that calls it, decompress is the part of load_seq spent decompressing, and the waits are the control thread's, for a ring slot, for an hmm buffer's last
+//tiles, for the next models to be loaded and for a tile plan to come free
+enum { ST_LOAD_SEQ, ST_LOAD_HMM, ST_KERNEL, ST_MERGE, ST_FORMAT, ST_NBUSY = ST_FORMAT + 1,
+       ST_OUTPUT = ST_NBUSY, ST_DECOMP, ST_WAIT_SLOT, ST_WAIT_HMM, ST_WAIT_MODELS, ST_WAIT_PLAN, ST_NSTAGES,
+       TR_SPAWN = ST_NSTAGES };   //--trace only: the control thread spawning a work block
+static const char *stage_name[ST_NSTAGES + 1] = { "load_seq", "load_hmm", "kernel", "merge", "format", "output", "decompress",
+                                                  "wait_slot", "wait_hmm", "wait_models", "wait_plan", "spawn_block" };
+
+typedef struct
+{
+  uint64_t calls;
+  double   wall;
+  double   cpu;       //of the thread making the call; work it hands to other threads isn't in it
+} STAGE_TIME;
+
+//--trace: a timeline of every stage above, one ring of events per thread, written out as Chrome trace-event
+//JSON at exit. a kernel event has the model, the sequence range and its parent: the work block it came from,
+//or with --sched split the unit it was split off. ids are per thread counters; blocks have their own
+#define TRACE_RING  32768                  //events kept per thread; the oldest are overwritten
+#define TRACE_BLOCK (UINT64_C(1) << 63)    //marks a block number used as a parent
+
+typedef struct
+{
+  double   t0, t1;
+  int      stage;
+  int      name;       //kernel: model name, an index into TRACE name[]
+  int      start, end; //kernel: sequence range
+  int64_t  residues;
+  uint64_t id;
+  uint64_t parent;
+} TRACE_EVENT;
+
+typedef struct
+{
+  char        *file;
+  int          pid;       //the MPI rank
+  TRACE_EVENT *ev;        //[thread * TRACE_RING + n % TRACE_RING]
+  uint64_t    *nev;       //per thread: events recorded so far
+  uint64_t    *nextid;
+  uint64_t    *pending;   //parent of the next kernel this thread starts
+  char       **name;
+  int          nname, nalloc;
+} TRACE;
+
+typedef struct
+{
+  FILE       *fp;       //NULL without --stats: only --trace uses this
+  TRACE      *trace;    //NULL without --trace
+  int         nthreads;
+  double      t0;
+  STAGE_TIME *st;     //[thread * ST_NSTAGES + stage]
+  uint64_t   *tiles;  //per thread: tiles run, tiles stolen from another deque, units split off (--sched split)
+  uint64_t   *steals;
+  uint64_t   *splits;
+  uint64_t    nmodels, nseqs, nres, n_past_msv, n_past_bias, n_past_vit, n_past_fwd, n_output;
+  double      cells;  //model positions x residues
+} RUN_STATS;
+
+//the output files, in the order the per-model output buffers and the checkpoint record keep them
+enum { OUT_MAIN, OUT_TBL, OUT_DOMTBL, OUT_PFAMTBL, OUT_ALI, OUT_NSTREAMS };
+
+//--checkpoint: progress of a run, rewritten after every hmm buffer whose output is safely on disk.
+//a restart with the same arguments cuts the output files back to off[] and skips the first nmodels models
+typedef struct
+{
+  char     *file;
+  uint64_t  args;                 //hash of the arguments that change the output
+  int       resume;               //a checkpoint of this run was found at startup
+  int64_t   nmodels;              //models whose output is complete
+  int       nquery;
+  off_t     off[OUT_NSTREAMS];    //output file sizes after those models
+} CHECKPOINT;
+
 typedef struct
 {
   FILE *ofp;
@@ -49,14 +234,324 @@ typedef struct
   ESL_ALPHABET *abc;
   ESL_GETOPTS *go;
   int textw;
+  int noali;          //--noali and no -A: no alignment is ever printed, so hits keep only what the tables need
   int threads;
+  WORK_POOL *pool;    //one entry per thread of the parallel region
+  TILE_SCHED *sched;
+  CHECKPOINT *ckpt;   //NULL without --checkpoint
+  NUMA_INFO *numa;    //NULL without --numa
+  RUN_STATS *stats;   //NULL without --stats
+  int rank;           //this process's MPI rank and the number of ranks; 0 and 1 without --mpi.
+  int nranks;         //only rank 0 writes output
+#ifdef HAVE_MPI
+  char *mpi_buf;      //pack buffer for sending results to rank 0
+  int   mpi_nalloc;
+#endif
 } OUTPUT_INFO;
 
+//a pre-digitized database built by hpc_makeseqdb, mapped read only.
+//sequence buffers hold views whose dsq/name/acc/desc point straight into the mapping
+typedef struct
+{
+  int               fd;
+  void             *base;
+  size_t            size;
+  HPC_SEQDB_HEADER *hdr;
+  HPC_SEQDB_ENTRY  *idx;
+  ESL_DSQ          *res;
+  char             *str;
+  uint64_t          first;  //the range of sequences searched, [first, last): all of them unless sharded
+  uint64_t          last;
+  uint64_t          next;   //index of the next sequence to hand out; a rewind just goes back to first
+} SEQDB_MAP;
+
+//compressed or piped targets for the chunked FASTA reader. the decompressed stream is cut into blocks that can
+//each be decompressed on their own: bgzip members and zstd frames as they are, and a plain gzip stream at access
+//points every ZSRC_SPAN bytes of output, each keeping the 32 KB window the inflater needs to start there (as
+//zlib's zran example does). a regular file made of bgzip members or sized zstd frames is indexed up front from
+//their headers. anything else is decompressed serially on its first pass, which records the index as it goes,
+//and stdin is copied to an unlinked spool file on the way. after that the compressed bytes are mapped, batches of
+//blocks are decompressed by parallel tasks, and a rewind starts again at the block holding its offset instead of
+//at byte zero of the stream. a block too big for a batch (one huge zstd frame) is decompressed serially from its start
+enum { ZSRC_NONE = 0, ZSRC_GZIP, ZSRC_ZSTD };
+
+#define ZSRC_IN     (1024 * 1024)        //compressed bytes read at a time by the serial decoder
+#define ZSRC_SPAN   (8 * 1024 * 1024)    //gzip access points: 32 KB of window per 8 MB of sequence
+#define ZSRC_WINDOW 32768
+#define ZSRC_BATCH  (64 * 1024 * 1024)   //uncompressed bytes decompressed together by parallel tasks
+#define ZSRC_GRAIN  (1024 * 1024)        //about this much of a batch per task
+
+typedef struct
+{
+  off_t          coff;     //compressed offset where decoding starts
+  off_t          uoff;     //uncompressed offset of the block's first byte
+  size_t         ulen;
+  int            bits;     //gzip access point: the low bits of the byte before coff that it starts with
+  int            wlen;
+  unsigned char *window;   //gzip access point: the output before it. NULL at the start of a member or frame
+} ZBLOCK;
+
+typedef struct
+{
+  int            codec;    //ZSRC_NONE is only for stdin, which must be spooled even uncompressed
+  const char    *name;
+  int            fd;       //the compressed file, or stdin
+  FILE          *spool;    //stdin: everything read from it, for the passes after the first
+  unsigned char *map;      //the whole compressed file (or spool), once its size is final
+  size_t         csize;
+  ZBLOCK        *blk;
+  int            nblk, balloc;
+  int            indexed;  //blk covers the whole stream, usize is known, and map is set
+  off_t          usize;
+  off_t          upos;     //uncompressed offset of the next byte zsrc_Read hands out
+  unsigned char *out;      //a decompressed batch: uncompressed bytes [ostart, ostart + olen)
+  size_t         olen, oalloc;
+  off_t          ostart;
+  size_t         batch;    //ZSRC_BATCH, or 0 for a single block
+
+  //the serial decoder: the first pass, and blocks too big for a batch
+  unsigned char *in;       //compressed bytes [cin, cin + inlen), of which inpos are consumed
+  size_t         inlen, inpos;
+  off_t          cin;
+  off_t          uout;     //uncompressed offset of its next byte
+  int            at_start; //the next compressed byte starts a gzip member or zstd frame
+  int            done;
+#ifdef HAVE_ZLIB
+  z_stream       zs;
+#endif
+#ifdef HAVE_ZSTD
+  ZSTD_DStream  *zd;
+#endif
+  RUN_STATS     *stats;    //--stats: its time is the decompress stage
+} ZSRC;
+
+//FASTA read as raw bytes in large chunks. records are located by a fast scan for '>' at the
+//start of a line, then digitized by several tasks at once instead of one esl_sqio_Read at a time
+#define FASTA_CHUNK (16 * 1024 * 1024)
+
+typedef struct
+{
+  int                 fd;
+  ZSRC               *z;        //compressed or stdin: bytes come through this instead of fd
+  char               *filename;
+  const ESL_ALPHABET *abc;
+  char               *buf;      //raw bytes; buf[0] is always at a record start (or the start of the file)
+  size_t              nbuf;
+  size_t              balloc;
+  off_t               foff;     //file offset of buf[0] (uncompressed offset, with z)
+  off_t               start;    //byte range searched, [start, stop): the whole file unless sharded.
+  off_t               stop;     //both ends are record starts (or the end of the file)
+  int                 eof;      //read() has returned 0 since the last rewind
+  size_t             *rec;      //record start offsets in buf, for the buffer being loaded
+  int                 ralloc;
+} FASTA_READER;
+
+//where the target sequences come from: exactly one of these is set
+//
+//easel's reader can't seek to a byte range in every format, so a shard of it keeps every
+//nshards-th sequence starting at number shard. the other sources restrict their own ranges.
+//a --restrictdb slice starts at firstkey (positioned through SSI) and ends after limit sequences;
+//a rewind goes back to the start of the slice, not of the file
+typedef struct
+{
+  ESL_SQFILE   *dbfp;
+  SEQDB_MAP    *map;
+  FASTA_READER *fa;
+  int           shard;
+  int           nshards;
+  uint64_t      nread;     //sequences read by easel since the last rewind
+  char         *firstkey;  //NULL: from the start of the file (or shard)
+  int64_t       limit;     //-1: to the end of the file (or shard)
+  int64_t       taken;     //sequences handed out since the last rewind
+  ESL_SQ       *sq;        //easel reads into this, then it is copied into a buffer's arena
+  int           held;      //sq is a sequence that didn't fit in the last buffer; it starts the next
+} SEQ_SOURCE;
+
+//where the next load of a source starts, so that a later pass can carry on from there (--seq_cache)
+typedef struct
+{
+  off_t    off;     //next record: a file offset, or an index into a mapping; -1 when there are none left
+  uint64_t nread;
+  int64_t  taken;
+} SEQ_POS;
+
+//a sequence buffer as the kernels see it: count records laid out like an hpc_makeseqdb index, whose offsets
+//are into the buffer's residue arena, or straight into a mapped database. a loader parses each sequence into
+//the arena as [sentinel][residues][sentinel][name][acc][desc], so a buffer is two allocations however many
+//sequences it has. the kernels make an ESL_SQ view of a record on the stack as they reach it; the pipeline
+//copies the strings only for hits. a load stops after size sequences or budget bytes (--seq_buffer_mb),
+//whichever comes first. res_sum[i] is the residue total of rec[0..i-1], so work can be split by residues
+typedef struct
+{
+  HPC_SEQDB_ENTRY    *rec;
+  ESL_DSQ            *res;       //base of the records' dsq_off: the arena, or the mapped residue section
+  char               *str;       //base of their name, acc and desc offsets
+  char               *arena;     //NULL when the source is a mapped database
+  size_t              asize;     //arena capacity: budget, unless one sequence alone is bigger
+  size_t              aused;
+  size_t              budget;
+  const ESL_ALPHABET *abc;
+  int64_t            *res_sum;
+  int                 count;
+  int                 size;
+  int                 sort;      //--seq_sort: each load orders rec[0..count-1] by length (within each slice)
+  int                *slice;     //rec[slice[k]..slice[k+1]-1] live on numa node k; a single slice without --numa
+  size_t             *abound;    //--numa: arena bytes [abound[k], abound[k+1]) were first touched on node k
+  int                 nslices;
+} SEQ_BUFFER;
+
+typedef struct
+{
+  int     hb_idx;
+  int     start, end;   //sequence range in the buffer
+  int     node;         //slice the range is in
+  double  cost;         //estimate: M x residues
+} TILE;
+
+typedef struct
+{
+  omp_lock_t  lock;
+  int        *tile;     //indices into the tile array; the owner takes from head, thieves from tail
+  int         head, tail;
+  double      left;     //estimated cost still in the deque
+} TILE_DEQUE;
+
+struct tile_sched_s
+{
+  int         mode;
+  TILE       *tile;
+  int         ntiles, talloc;
+  TILE_DEQUE *dq;       //one per worker task, as many as threads
+  int        *slot;     //backing store for the deques
+  int         nworkers;
+  int         per_thread; //tiles planned per worker, TILES_PER_THREAD unless --mem chose
+  int         active;   //worker tasks of the planned block still running; the plan is kept until 0
+  HMM_BUFFER **hb;      //the block that was planned
+  int          nhmm;
+  SEQ_BUFFER  *sb;
+  int         *refs[2]; //counts each finished tile takes one off (NULL: none), see SEQ_RING
+  NUMA_INFO   *numa;    //deque w belongs to thread w, and its tiles are from that thread's node
+  RUN_STATS   *stats;   //counts the tiles stolen
+  uint64_t     block;   //--trace: the block planned here, the parent of its tiles
+  double     *busy;     //--bench_sched only: per thread seconds in kernels, and when each last finished one
+  double     *done;
+};
+
+//a sequence buffer in the ring, and how many tiles of the blocks reading it have not finished.
+//it is refilled once that is 0
+typedef struct
+{
+  SEQ_BUFFER *sb;
+  int         refs;
+  int         eof;      //sb holds the last sequences of a pass through the database
+  int         cached;   //sb belongs to the --seq_cache, not to the slot
+} SEQ_SLOT;
+
+//an hmm buffer and the tiles still searching it. once they are done it is written out and
+//refilled by a task, while the other hmm buffer is being searched
+typedef struct
+{
+  HMM_BUFFER **hb;
+  int          refs;
+  int          loading; //1 while that task runs
+  int          hstatus; //what its load_hmm_buffer returned
+} HMM_SET;
+
+//--seq_ring: the sequence buffers a search streams through. a block (hmm buffer x slot) is spawned
+//without waiting for the one before, so up to nslots of them are in flight and loading runs ahead
+//of the search by nslots-1 buffers. each block keeps its own plan until its last worker is done
+typedef struct
+{
+  SEQ_SLOT    *slot;
+  int          nslots;
+  TILE_SCHED **ts;
+  int          nts;
+  int          nblocks; //blocks spawned so far; block b is planned in ts[b % nts]
+} SEQ_RING;
+
+//--seq_cache: buffers of the first pass kept as they were loaded, so later passes don't read and digitize
+//them again. every pass is the same cyclic scan, and LRU would evict each buffer just before it is needed
+//again, so nothing is evicted: buffers are admitted in pass order until one doesn't fit, and later passes
+//take that prefix from memory, seek past it and stream the rest through the ring.
+//a slot holding a cached buffer lends its own to spare; it gets one back when it next loads
+typedef struct
+{
+  SEQ_BUFFER  **buf;
+  int          *eof;
+  int           n, alloc;
+  size_t        bytes, cap;
+  int           admitting;  //first pass, and nothing turned away yet
+  int           next;       //the buffer of the pass that comes next
+  SEQ_POS       resume;     //the source just after buf[n-1]
+  SEQ_BUFFER  **spare;
+  int           nspare;
+  int           size;       //for new ring buffers, as seq_buffer_Create
+  size_t        budget;
+  int           sort;
+  ESL_ALPHABET *abc;
+  NUMA_INFO    *numa;
+} SEQ_CACHE;
+
 //utility code has been moved to functions to make the openmp control flow more compact and readable
-static int load_seq_buffer(ESL_SQFILE *dbfp, ESL_SQ **sbb, int seq_per_buffer);
+static int seqdb_Open(const char *dbfile, SEQDB_MAP **ret_map);
+static void seqdb_Close(SEQDB_MAP *map);
+static void seqdb_Shard(SEQDB_MAP *map, int shard, int nshards);
+static int seqfile_IsStream(const char *dbfile);
+static int fasta_Open(const char *dbfile, FASTA_READER **ret_fa);
+static void fasta_Close(FASTA_READER *fa);
+static void fasta_Shard(FASTA_READER *fa, int shard, int nshards);
+static void seq_source_Restrict(SEQ_SOURCE *src, char *firstkey, int64_t limit, char *ssifile);
+static void benchmark_loaders(char *dbfile, int dbfmt, ESL_ALPHABET *abc, int seq_per_buffer, size_t budget, int threads, FILE *ofp);
+static SEQ_BUFFER *seq_buffer_Create(SEQ_SOURCE *src, int size, size_t budget, int sort, ESL_ALPHABET *abc, NUMA_INFO *numa);
+static void seq_buffer_Destroy(SEQ_BUFFER *sb);
+static int load_seq_buffer(SEQ_SOURCE *src, SEQ_BUFFER *sb);
+static void seq_buffer_Reserve(SEQ_BUFFER *sb, size_t need);
+static int seq_buffer_Append(SEQ_BUFFER *sb, const ESL_DSQ *dsq, int64_t n, const char *name, const char *acc, const char *desc);
+static void seq_buffer_Slice(SEQ_BUFFER *sb);
+static void seq_View(const SEQ_BUFFER *sb, int x, ESL_SQ *sq);
 static int load_hmm_buffer(P7_HMMFILE *hfp, HMM_BUFFER **hb, int *nquery, int buffer_size, ESL_ALPHABET *abc, ESL_GETOPTS *go);
+static TOPK *topk_Create(int k);
+static void topk_Destroy(TOPK *tk);
 static int output_hmm_buffer(HMM_BUFFER **hb, int buffer_size, int nquery, OUTPUT_INFO *oi);
-static int thread_kernel(HMM_BUFFER *hb, ESL_SQ **sbb, int start, int end, ESL_GETOPTS *go, OUTPUT_INFO *oi);
+static uint64_t checkpoint_Hash(ESL_GETOPTS *go);
+static void checkpoint_Read(CHECKPOINT *ck);
+static FILE *checkpoint_Open(CHECKPOINT *ck, int which, const char *filename);
+static void skip_hmm_models(P7_HMMFILE *hfp, int64_t n, ESL_ALPHABET *abc);
+static int thread_kernel(HMM_BUFFER *hb, SEQ_BUFFER *sb, int start, int end, ESL_GETOPTS *go, OUTPUT_INFO *oi);
+static WORK_POOL *work_pool_Create(int nthreads);
+static void work_pool_Destroy(WORK_POOL *pool, int nthreads);
+static TILE_SCHED *tile_sched_Create(int nworkers, int mode, NUMA_INFO *numa);
+static void tile_sched_Destroy(TILE_SCHED *ts);
+static void run_work_block(TILE_SCHED *ts, HMM_BUFFER **hb, int nhmm, SEQ_BUFFER *sb, ESL_GETOPTS *go, OUTPUT_INFO *oi);
+static SEQ_RING *seq_ring_Create(SEQ_SOURCE *src, int nslots, int size, size_t budget, int sort, ESL_ALPHABET *abc, int nworkers, int mode, NUMA_INFO *numa);
+static void seq_ring_Destroy(SEQ_RING *ring);
+static SEQ_CACHE *seq_cache_Create(size_t cap, int nslots, int size, size_t budget, int sort, ESL_ALPHABET *abc, NUMA_INFO *numa);
+static void seq_cache_Destroy(SEQ_CACHE *sc);
+static void seq_cache_Next(SEQ_CACHE *sc, SEQ_SOURCE *src, SEQ_SLOT *ss);
+static void seq_cache_Rewind(SEQ_CACHE *sc, SEQ_SOURCE *src);
+static void ring_wait(SEQ_RING *ring, int *count, int stage, ESL_GETOPTS *go, OUTPUT_INFO *oi);
+static void ring_spawn_block(SEQ_RING *ring, HMM_SET *hs, SEQ_SLOT *ss, int nhmm, ESL_GETOPTS *go, OUTPUT_INFO *oi);
+static void hmm_set_Reload(HMM_SET *hs, int more, P7_HMMFILE *hfp, int *nquery, int nhmm, ESL_GETOPTS *go, OUTPUT_INFO *oi);
+static void search_models(P7_HMMFILE *hfp, HMM_SET *hset, int hmm_buffer_size, int *nquery, SEQ_RING *ring, SEQ_CACHE *cache, SEQ_SOURCE *src, ESL_GETOPTS *go, OUTPUT_INFO *oi);
+static void daemon_Serve(const char *path, HMM_SET *hset, int hmm_buffer_size, SEQ_RING *ring, SEQ_CACHE *cache, SEQ_SOURCE *src,
+                         char *dbfile, ESL_GETOPTS *go, OUTPUT_INFO *oi);
+static void benchmark_sched(HMM_BUFFER **hb, int nhmm, SEQ_BUFFER *sb, ESL_GETOPTS *go, OUTPUT_INFO *oi, FILE *ofp);
+#ifdef HAVE_MSV_BATCH
+static void benchmark_msv(HMM_BUFFER **hb, int nhmm, SEQ_BUFFER *sb, FILE *ofp);
+#endif
+static int simd_Select(ESL_GETOPTS *go);
+static NUMA_INFO *numa_Create(int nthreads);
+static void numa_Destroy(NUMA_INFO *numa);
+static void numa_Pin(NUMA_INFO *numa);
+static void numa_Report(NUMA_INFO *numa, int nthreads, FILE *fp);
+static RUN_STATS *stats_Create(FILE *fp, int nthreads);
+static void stats_Start(RUN_STATS *rs, double *t);
+static void stats_Stop(RUN_STATS *rs, int stage, double *t);
+static void stats_Model(RUN_STATS *rs, HMM_BUFFER *hb);
+static void stats_Write(RUN_STATS *rs, OUTPUT_INFO *oi);
+static void stats_Destroy(RUN_STATS *rs);
+static void trace_Create(RUN_STATS *rs, char *file, int rank, int nranks);
+static void trace_Write(RUN_STATS *rs);
 
 
 #define REPOPTS     "-E,-T,--cut_ga,--cut_nc,--cut_tc"
@@ -83,6 +578,7 @@ static ESL_OPTIONS options[] = {
   { "-T",           eslARG_REAL,   FALSE, NULL, NULL,    NULL,  NULL,  REPOPTS,         "report sequences >= this score threshold in output",           4 },
   { "--domE",       eslARG_REAL,  "10.0", NULL, "x>0",   NULL,  NULL,  DOMREPOPTS,      "report domains <= this E-value threshold in output",           4 },
   { "--domT",       eslARG_REAL,   FALSE, NULL, NULL,    NULL,  NULL,  DOMREPOPTS,      "report domains >= this score cutoff in output",                4 },
+  { "--top_k",      eslARG_INT,    FALSE, NULL, "n>=1",  NULL,  NULL,  NULL,            "report only the <n> best sequences of each model",             4 },
   /* Control of inclusion (significance) thresholds */
   { "--incE",       eslARG_REAL,  "0.01", NULL, "x>0",   NULL,  NULL,  INCOPTS,         "consider sequences <= this E-value threshold as significant",  5 },
   { "--incT",       eslARG_REAL,   FALSE, NULL, NULL,    NULL,  NULL,  INCOPTS,         "consider sequences >= this score threshold as significant",    5 },
@@ -105,11 +601,37 @@ static ESL_OPTIONS options[] = {
   { "--domZ",       eslARG_REAL,   FALSE, NULL, "x>0",   NULL,  NULL,  NULL,            "set # of significant seqs, for domain E-value calculation",   12 },
   { "--seed",       eslARG_INT,    "42",  NULL, "n>=0",  NULL,  NULL,  NULL,            "set RNG seed to <n> (if 0: one-time arbitrary seed)",         12 },
   { "--tformat",    eslARG_STRING,  NULL, NULL, NULL,    NULL,  NULL,  NULL,            "assert target <seqfile> is in format <s>: no autodetection",  12 },
+  { "--restrictdb_stkey", eslARG_STRING, NULL, NULL, NULL, NULL,  NULL,  "--restrictdb_shard", "search starts at the sequence with name <s>",          12 },
+  { "--restrictdb_n",     eslARG_INT,    "-1", NULL, NULL, NULL,  NULL,  "--restrictdb_shard", "search <n> target sequences (starting at --restrictdb_stkey)", 12 },
+  { "--ssifile",          eslARG_STRING, NULL, NULL, NULL, NULL,  NULL,  NULL,            "restrictdb_x values require ssi file. Override default to <s>", 12 },
+  { "--restrictdb_shard",   eslARG_INT,  NULL, NULL, "n>=0", NULL, "--restrictdb_nshards", NULL, "search only shard <n> (from 0) of the target database", 12 },
+  { "--restrictdb_nshards", eslARG_INT,  NULL, NULL, "n>=1", NULL, "--restrictdb_shard",   NULL, "number of shards for --restrictdb_shard",            12 },
 
 // thread buffer related parameters
-  { "--seq_buffer", eslARG_INT, "200000", NULL, "n>=1", NULL, NULL, NULL,               "set # of sequences per thread buffer",                        13 },
+  { "--seq_buffer", eslARG_INT, "200000", NULL, "n>=1", NULL, NULL, NULL,               "set max # of sequences per sequence buffer",                  13 },
+  { "--seq_buffer_mb", eslARG_INT, "256", NULL, "n>=1",  NULL, NULL, NULL,               "set MB of residues and names per sequence buffer",            13 },
   { "--hmm_buffer", eslARG_INT,     "500", NULL, "n>=1", NULL, NULL, NULL,               "set # of hmms per thread hmm buffer",                         13 },
+  { "--mem",        eslARG_INT,      NULL, NULL, "n>=64", NULL, NULL, NULL,               "size buffers to a memory budget of <n> MB, from sampled inputs", 13 },
+  { "--seq_cache",  eslARG_INT,      NULL, NULL, "n>=1", NULL, NULL, NULL,                "keep up to <n> MB of loaded sequence buffers for later passes", 13 },
+  { "--seq_ring",   eslARG_INT,      "3", NULL, "n>=2",  NULL,  NULL,  NULL,            "sequence buffers in flight: loading runs up to <n>-1 ahead",  13 },
+  { "--stats",      eslARG_OUTFILE, NULL, NULL, NULL,    NULL,  NULL,  NULL,            "write a JSON report of time per stage, thread use and filter counts to <f>", 13 },
+  { "--trace",      eslARG_OUTFILE, NULL, NULL, NULL,    NULL,  NULL,  NULL,            "write a Chrome trace-event timeline of kernels, loads and output to <f>", 13 },
+  { "--numa",       eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL,  NULL,            "pin threads to NUMA nodes and keep their work on local memory", 13 },
   { "--cpu",        eslARG_INT,      "1", "OMP_NUM_THREADS", "n>=1", NULL, NULL, NULL,  "set # of threads",                                            13 },
+  { "--seq_sort",   eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL,  NULL,            "order each sequence buffer by length",                        13 },
+  { "--noparload",  eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL,  NULL,            "read FASTA targets with easel's serial reader",               13 },
+  { "--bench_load", eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL,  NULL,            "time one pass of each sequence loader over <seqdb>, then exit", 13 },
+  { "--nomsvbatch", eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL, "--simd",         "run the MSV filter one target at a time, not batched",        13 },
+  { "--simd",       eslARG_STRING, "auto", NULL, NULL,   NULL,  NULL, "--nomsvbatch",   "batched filter kernels: auto, sse, avx2, avx512 or none",     13 },
+  { "--bench_msv",  eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL,  NULL,            "time and check batched vs striped MSV on the first buffers, then exit", 13 },
+  { "--sched",      eslARG_STRING, "tiles", NULL, NULL,  NULL,  NULL,  NULL,            "work scheduler: tiles, or split (the old halving heuristic)", 13 },
+  { "--bench_sched", eslARG_NONE,  FALSE, NULL, NULL,    NULL,  NULL,  NULL,            "time the first work block under both schedulers, then exit", 13 },
+  { "--checkpoint", eslARG_STRING,  NULL, NULL, NULL,    NULL,  "-o", "--bench_load,--bench_msv,--bench_sched", "record progress in <f> after each hmm buffer; resume from it", 13 },
+  { "--daemon",     eslARG_STRING,  NULL, NULL, NULL,    NULL,  NULL, "-o,-A,--tblout,--domtblout,--pfamtblout,--checkpoint,--bench_load,--bench_msv,--bench_sched",
+                                                                                           "serve searches over UNIX socket <f>; <hmmfile> only sets the alphabet", 13 },
+#ifdef HAVE_MPI
+  { "--mpi",        eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL, "--bench_load,--bench_msv,--bench_sched,--restrictdb_stkey,--restrictdb_n,--daemon", "run as an MPI program, each rank searching a shard of <seqdb>", 13 },
+#endif
 
   {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
 };
@@ -201,7 +723,226 @@ ERROR:
   exit(status);
 }
 
-static int output_header(FILE *ofp, const ESL_GETOPTS *go, char *hmmfile, char *seqfile)
+//--mem: buffer sizes and tile granularity from a memory budget instead of from --seq_buffer, --seq_buffer_mb
+//and --hmm_buffer. the first models and sequences are read once more to measure them; the rest is arithmetic,
+//and each decision leaves a line for the output header. any of those three options given explicitly still wins
+#define MEM_SAMPLE_HMMS  32
+#define MEM_SAMPLE_SEQS  4000
+#define MEM_FIXED        (64.0 * 1048576)   //program, hit lists and output, whatever the buffers
+#define MEM_TILE_CELLS   2e8                //model positions x residues per tile: a fraction of a second
+#define MEM_PRIME_MB     1024               //a streamed buffer bigger than this only delays the first block
+#define MEM_NNOTES       10
+
+typedef struct
+{
+  double  budget;                        //bytes
+  int     nhmm, all_hmms;                //models sampled; all_hmms: that was every model in the file
+  double  meanM, om_bytes;               //om_bytes: mean p7_oprofile_Sizeof
+  int     maxM;
+  int     nseq;                          //sequences sampled, 0 when there was nothing to sample
+  double  meanL, str_bytes;              //str_bytes: name, acc and desc with their NULs
+  int64_t maxL;
+  double  db_seqs;                       //estimated sequences this process searches; 0 if unknown
+  int     seq_buffer, seq_mb, hmm_buffer, tiles;
+  int     seq_cache;                     //MB for --seq_cache, 0 for none
+  char    note[MEM_NNOTES][160];
+  int     nnotes;
+} MEM_PLAN;
+
+static void mem_Note(MEM_PLAN *mp, const char *fmt, ...)
+{
+  va_list ap;
+
+  if(mp->nnotes == MEM_NNOTES) return;
+  va_start(ap, fmt);
+  vsnprintf(mp->note[mp->nnotes++], sizeof(mp->note[0]), fmt, ap);
+  va_end(ap);
+}
+
+//size and length of the first models. only their sizes matter, so an unconfigured profile of the right M will do
+static void mem_SampleModels(MEM_PLAN *mp, char *hmmfile, const ESL_ALPHABET *abc)
+{
+  P7_HMMFILE   *hfp = NULL;
+  P7_HMM       *hmm = NULL;
+  ESL_ALPHABET *habc = (ESL_ALPHABET *) abc;
+  int           status;
+
+  mp->nhmm = mp->maxM = 0;
+  mp->meanM = mp->om_bytes = 0.;
+  mp->all_hmms = FALSE;
+  if(strcmp(hmmfile, "-") == 0 || p7_hmmfile_OpenE(hmmfile, NULL, &hfp, NULL) != eslOK) return;
+  while(mp->nhmm < MEM_SAMPLE_HMMS && (status = p7_hmmfile_Read(hfp, &habc, &hmm)) == eslOK)
+  {
+    P7_OPROFILE *om = p7_oprofile_Create(hmm->M, abc);
+
+    mp->meanM    += hmm->M;
+    mp->om_bytes += p7_oprofile_Sizeof(om);
+    mp->maxM      = ESL_MAX(mp->maxM, hmm->M);
+    mp->nhmm++;
+    p7_oprofile_Destroy(om);
+    p7_hmm_Destroy(hmm);
+  }
+  mp->all_hmms = (mp->nhmm < MEM_SAMPLE_HMMS);
+  p7_hmmfile_Close(hfp);
+  if(mp->nhmm) mp->meanM /= mp->nhmm, mp->om_bytes /= mp->nhmm;
+}
+
+//length and string bytes of the first sequences, and how many sequences this process will search.
+//a mapped database knows its size; a file's is its bytes over the bytes per sequence of the sample.
+//stdin and compressed files aren't sampled, and their size is left unknown
+static void mem_SampleSeqs(MEM_PLAN *mp, const SEQ_SOURCE *src, char *dbfile, int dbfmt)
+{
+  ESL_SQFILE *sqfp = NULL;
+  ESL_SQ     *sq   = NULL;
+  off_t       first = -1, last = 0;
+  struct stat st;
+
+  mp->nseq = 0;
+  mp->meanL = mp->str_bytes = mp->db_seqs = 0.;
+  mp->maxL = 0;
+
+  if(src->map)
+  {
+    const SEQDB_MAP *map = src->map;
+    uint64_t         x;
+
+    for(x = map->first; x < map->last && mp->nseq < MEM_SAMPLE_SEQS; x++, mp->nseq++)
+    {
+      mp->meanL += map->idx[x].len;
+      mp->maxL   = ESL_MAX(mp->maxL, (int64_t) map->idx[x].len);
+    }
+    mp->str_bytes = map->hdr->nseq ? (double) map->hdr->str_size / map->hdr->nseq : 0.;
+    mp->db_seqs   = (double) (map->last - map->first);
+  }
+  else if(! seqfile_IsStream(dbfile) && esl_sqfile_Open(dbfile, dbfmt, p7_SEQDBENV, &sqfp) == eslOK)
+  {
+    sq = esl_sq_Create();
+    while(mp->nseq < MEM_SAMPLE_SEQS && esl_sqio_Read(sqfp, sq) == eslOK)
+    {
+      if(first < 0) first = sq->roff;
+      last           = sq->eoff;
+      mp->meanL     += sq->n;
+      mp->maxL       = ESL_MAX(mp->maxL, sq->n);
+      mp->str_bytes += strlen(sq->name) + strlen(sq->acc) + strlen(sq->desc) + 3;
+      mp->nseq++;
+      esl_sq_Reuse(sq);
+    }
+    esl_sq_Destroy(sq);
+    esl_sqfile_Close(sqfp);
+    if(mp->nseq) mp->str_bytes /= mp->nseq;
+
+    if(mp->nseq && last > first && stat(dbfile, &st) == 0)
+    {
+      double bytes = src->fa ? (double) (src->fa->stop - src->fa->start) : (double) st.st_size / src->nshards;
+
+      mp->db_seqs = bytes / ((double) (last - first + 1) / mp->nseq);
+    }
+  }
+  if(mp->nseq) mp->meanL /= mp->nseq;
+  if(mp->db_seqs > 0. && src->limit >= 0) mp->db_seqs = ESL_MIN(mp->db_seqs, (double) src->limit);
+}
+
+//split the budget. the DP matrices of every thread come off the top; of the rest a quarter is for the two hmm
+//buffers, three fifths for the sequence ring, and what is left is headroom for hits and the allocator.
+//a database that fits the ring's share is loaded once into a single buffer and stays there. one that doesn't
+//gets half of the share for the ring and the rest for --seq_cache, where the source can be cached
+static void mem_Plan(MEM_PLAN *mp, const ESL_GETOPTS *go, const SEQ_SOURCE *src, char *hmmfile, char *dbfile, int dbfmt, const ESL_ALPHABET *abc)
+{
+  int    threads = esl_opt_GetInteger(go, "--cpu");
+  int    nslots  = esl_opt_GetInteger(go, "--seq_ring");
+  int    numa    = esl_opt_GetBoolean(go, "--numa");
+  int    cacheable = ! src->map && (src->fa || ! seqfile_IsStream(dbfile));
+  double MB      = 1048576.;
+  double meanM, meanL, maxL, env, dp, avail, per_model, hmm_share, seq_share, arena_per_seq, per_seq, residues, cells;
+
+  mp->budget    = esl_opt_GetInteger(go, "--mem") * MB;
+  mp->nnotes    = 0;
+  mp->seq_cache = 0;
+  mem_SampleModels(mp, hmmfile, abc);
+  mem_SampleSeqs(mp, src, dbfile, dbfmt);
+
+  //stdin, or a file that wouldn't open a second time: guess at a typical protein database
+  meanM = mp->nhmm ? mp->meanM : 300.;
+  meanL = mp->nseq ? mp->meanL : 350.;
+  maxL  = mp->nseq ? (double) mp->maxL : 5000.;
+  if(mp->nhmm) mem_Note(mp, "sampled %d models%s: mean M %.0f, max M %d, %.2f MB per profile", mp->nhmm,
+                        mp->all_hmms ? " (all of them)" : "", mp->meanM, mp->maxM, mp->om_bytes / MB);
+  if(mp->nseq) mem_Note(mp, "sampled %d sequences: mean L %.0f, max L %lld, %.0f bytes of names each", mp->nseq,
+                        mp->meanL, (long long) mp->maxL, mp->str_bytes);
+  else         mem_Note(mp, "no sequences sampled: assuming mean L %.0f, max L %.0f", meanL, maxL);
+  if(mp->nhmm == 0) mp->om_bytes = 24. * (meanM + 16) * 40, mp->maxM = (int) meanM;
+
+  //domain definition keeps a forward and a backward matrix of 12 bytes per cell over an envelope, which
+  //rarely runs past a few model lengths; each thread's pipeline grows them to the largest it has seen
+  env = ESL_MIN(maxL, 3. * mp->maxM + 100.);
+  dp  = 2. * 12. * (mp->maxM + 1) * (env + 1);
+  avail = mp->budget - MEM_FIXED - threads * dp;
+  mem_Note(mp, "%d threads x %.1f MB of DP matrices, plus %.0f MB fixed", threads, dp / MB, MEM_FIXED / MB);
+  if(avail < 16. * MB)
+    p7_Fail("--mem %d: too small; %d threads need about %.0f MB before any buffers\n", esl_opt_GetInteger(go, "--mem"),
+            threads, (MEM_FIXED + threads * dp) / MB + 16.);
+
+  //a model: its profile (and a copy per node under --numa, counted as one), bg, pipeline and hit list, and a
+  //results slot per thread
+  per_model  = mp->om_bytes * (numa ? 2. : 1.) + 32768. + threads * (sizeof(PLI_COUNTS) + sizeof(P7_TOPHITS *));
+  hmm_share  = 0.25 * avail;
+  mp->hmm_buffer = (int) ESL_MIN(hmm_share / (2. * per_model), 100000.);
+  if(mp->all_hmms) mp->hmm_buffer = ESL_MIN(mp->hmm_buffer, mp->nhmm);
+  mp->hmm_buffer = ESL_MAX(mp->hmm_buffer, 1);
+  mem_Note(mp, "hmm buffers: 2 x %d models x %.2f MB = %.0f MB", mp->hmm_buffer, per_model / MB, 2. * mp->hmm_buffer * per_model / MB);
+
+  //a sequence: its arena bytes, [sentinel][residues][sentinel][name][acc][desc], and its record and res_sum
+  //entry. a mapped database has no arena; its buffers only count residues against --seq_buffer_mb
+  seq_share     = 0.85 * avail - 2. * mp->hmm_buffer * per_model;
+  arena_per_seq = src->map ? meanL + 1. : meanL + 2. + (mp->nseq ? mp->str_bytes : 80.);
+  per_seq       = (src->map ? 0. : arena_per_seq) + sizeof(HPC_SEQDB_ENTRY) + sizeof(int64_t);
+  if(mp->db_seqs > 0.)
+    mem_Note(mp, "database: about %.0f sequences, %.0f MB in buffers", mp->db_seqs, mp->db_seqs * per_seq / MB);
+  else
+    mem_Note(mp, "database: size unknown (stdin or compressed)");
+
+  //under --numa every slot's arena is touched as it is allocated, so all of them count
+  if(mp->db_seqs > 0. && 1.05 * mp->db_seqs * per_seq <= seq_share / (numa ? nslots : 1))
+  {
+    mp->seq_buffer = (int) ESL_MIN(1.05 * mp->db_seqs + 16., (double) (INT_MAX / 2));
+    mp->seq_mb     = (int) (1.05 * mp->db_seqs * arena_per_seq / MB) + 1;
+    mem_Note(mp, "sequence buffers: the whole database fits one, %d MB, loaded once and kept", mp->seq_mb);
+  }
+  else
+  {
+    double slot = seq_share / (cacheable ? 2. * nslots : nslots);
+    double cache;
+
+    mp->seq_mb     = (int) ESL_MIN(slot * arena_per_seq / per_seq / MB, (double) MEM_PRIME_MB);
+    mp->seq_mb     = ESL_MAX(mp->seq_mb, 1);
+    //room for a quarter more sequences than the mean length predicts, so the MB budget is the one that binds
+    mp->seq_buffer = (int) ESL_MIN(1.25 * mp->seq_mb * MB / arena_per_seq + 16., (double) (INT_MAX / 2));
+    mem_Note(mp, "sequence buffers: %d x %d MB, up to %d sequences each%s", nslots, mp->seq_mb, mp->seq_buffer,
+             mp->seq_mb == MEM_PRIME_MB ? " (capped, so the first one loads quickly)" : "");
+
+    //the rest keeps the start of the database for the passes after the first
+    cache = seq_share - nslots * mp->seq_mb * MB * per_seq / arena_per_seq;
+    if(cacheable && cache >= 64. * MB)
+    {
+      mp->seq_cache = (int) (cache / MB);
+      if(mp->db_seqs > 0.) mem_Note(mp, "sequence cache: %d MB, about %.0f%% of the database", mp->seq_cache,
+                                    ESL_MIN(100., 100. * cache / (mp->db_seqs * per_seq)));
+      else                 mem_Note(mp, "sequence cache: %d MB", mp->seq_cache);
+    }
+  }
+
+  //tiles: enough that each is a fraction of a second of filter work, within reason
+  residues = ESL_MIN(mp->seq_mb * MB / arena_per_seq, (double) mp->seq_buffer) * meanL;
+  if(mp->db_seqs > 0.) residues = ESL_MIN(residues, mp->db_seqs * meanL);
+  cells    = (double) mp->hmm_buffer * meanM * residues / threads;
+  mp->tiles = (int) ESL_MAX(4., ESL_MIN(cells / MEM_TILE_CELLS, 32.));
+  mem_Note(mp, "%d tiles per thread, about %.2g cells each", mp->tiles, cells / mp->tiles);
+
+  if(esl_opt_IsUsed(go, "--seq_buffer") || esl_opt_IsUsed(go, "--seq_buffer_mb") || esl_opt_IsUsed(go, "--hmm_buffer") || esl_opt_IsUsed(go, "--seq_cache"))
+    mem_Note(mp, "--seq_buffer, --seq_buffer_mb, --hmm_buffer and --seq_cache given on the command line override these");
+}
+
+static int output_header(FILE *ofp, const ESL_GETOPTS *go, char *hmmfile, char *seqfile, const MEM_PLAN *mp)
 {
   p7_banner(ofp, go->argv[0], banner);
   
@@ -220,6 +961,7 @@ static int output_header(FILE *ofp, const ESL_GETOPTS *go, char *hmmfile, char *
   if (esl_opt_IsUsed(go, "-T")           && fprintf(ofp, "# sequence reporting threshold:    score >= %g\n",    esl_opt_GetReal(go, "-T"))             < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--domE")       && fprintf(ofp, "# domain reporting threshold:      E-value <= %g\n",  esl_opt_GetReal(go, "--domE"))         < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--domT")       && fprintf(ofp, "# domain reporting threshold:      score >= %g\n",    esl_opt_GetReal(go, "--domT"))         < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--top_k")      && fprintf(ofp, "# sequences reported per model:    <= %d\n",          esl_opt_GetInteger(go, "--top_k"))     < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--incE")       && fprintf(ofp, "# sequence inclusion threshold:    E-value <= %g\n",  esl_opt_GetReal(go, "--incE"))         < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--incT")       && fprintf(ofp, "# sequence inclusion threshold:    score >= %g\n",    esl_opt_GetReal(go, "--incT"))         < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--incdomE")    && fprintf(ofp, "# domain inclusion threshold:      E-value <= %g\n",  esl_opt_GetReal(go, "--incdomE"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
@@ -234,8 +976,36 @@ static int output_header(FILE *ofp, const ESL_GETOPTS *go, char *hmmfile, char *
   if (esl_opt_IsUsed(go, "--nobias")     && fprintf(ofp, "# biased composition HMM filter:   off\n")                                                   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 
   if (esl_opt_IsUsed(go, "--seq_buffer") && fprintf(ofp, "# sequences per sequence buffer:       <= %d\n",    esl_opt_GetInteger(go, "--seq_buffer"))       < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--seq_buffer_mb") && fprintf(ofp, "# MB per sequence buffer:           <= %d\n", esl_opt_GetInteger(go, "--seq_buffer_mb")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--hmm_buffer")       && fprintf(ofp, "# hmms per hmm buffer       <= %d\n",                     esl_opt_GetInteger(go, "--hmm_buffer"))             < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (mp)
+  {
+    int k;
+    if (fprintf(ofp, "# memory budget:                   %.0f MB\n", mp->budget / 1048576.)                                                        < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+    for (k = 0; k < mp->nnotes; k++)
+      if (fprintf(ofp, "#   %s\n", mp->note[k])                                                                                                   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  }
+  if (esl_opt_IsUsed(go, "--seq_cache")  && fprintf(ofp, "# sequence buffer cache:           <= %d MB\n",      esl_opt_GetInteger(go, "--seq_cache")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--seq_ring")   && fprintf(ofp, "# sequence buffers in flight:      %d\n",             esl_opt_GetInteger(go, "--seq_ring"))  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--cpu")    && fprintf(ofp, "# threads                   <= %d\n",                     esl_opt_GetInteger(go, "--cpu"))             < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--seq_sort")   && fprintf(ofp, "# sequence buffers sorted by:      length\n")                                                < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--stats")      && fprintf(ofp, "# run statistics (JSON):           %s\n",             esl_opt_GetString(go, "--stats"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--trace")      && fprintf(ofp, "# timeline trace:                  %s\n",             esl_opt_GetString(go, "--trace"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--numa")       && fprintf(ofp, "# NUMA placement:                  on\n")                                                    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--sched")      && fprintf(ofp, "# work scheduler:                  %s\n",             esl_opt_GetString(go, "--sched"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--checkpoint") && fprintf(ofp, "# checkpoint file:                 %s\n",             esl_opt_GetString(go, "--checkpoint")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--noparload")  && fprintf(ofp, "# parallel FASTA loading:          off\n")                                                   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (simd_level == SIMD_NONE            && fprintf(ofp, "# batched MSV filter:              off\n")                                                   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (simd_level != SIMD_NONE            && fprintf(ofp, "# batched MSV filter kernels:      %s, %d lanes%s\n", simd_name[simd_level], 16 << (simd_level - SIMD_SSE),
+                                                    esl_opt_IsUsed(go, "--simd") ? " (--simd)" : "")                                                   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+#ifdef HAVE_MPI
+  if (esl_opt_IsUsed(go, "--mpi"))
+  {
+    int nranks;
+    MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+    if (fprintf(ofp, "# MPI ranks (database shards):     %d\n", nranks)                                                                              < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  }
+#endif
 
   if (esl_opt_IsUsed(go, "--nonull2")    && fprintf(ofp, "# null2 bias corrections:          off\n")                                                   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "-Z")           && fprintf(ofp, "# sequence search space set to:    %.0f\n",           esl_opt_GetReal(go, "-Z"))             < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
@@ -246,6 +1016,11 @@ static int output_header(FILE *ofp, const ESL_GETOPTS *go, char *hmmfile, char *
     else if (                               fprintf(ofp, "# random number seed set to:       %d\n",             esl_opt_GetInteger(go, "--seed"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   }
   if (esl_opt_IsUsed(go, "--tformat")    && fprintf(ofp, "# targ <seqfile> format asserted:  %s\n",             esl_opt_GetString(go, "--tformat"))    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--restrictdb_stkey")   && fprintf(ofp, "# Restrict db to start at seq key: %s\n",        esl_opt_GetString(go, "--restrictdb_stkey"))    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--restrictdb_n")       && fprintf(ofp, "# Restrict db to # target seqs:    %d\n",        esl_opt_GetInteger(go, "--restrictdb_n"))       < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--ssifile")            && fprintf(ofp, "# Override ssi file to:            %s\n",        esl_opt_GetString(go, "--ssifile"))             < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--restrictdb_shard")   && fprintf(ofp, "# Restrict db to shard:            %d of %d\n",  esl_opt_GetInteger(go, "--restrictdb_shard"),
+                                                          esl_opt_GetInteger(go, "--restrictdb_nshards"))                                                      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (fprintf(ofp, "# - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -\n\n")                                                    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   return eslOK;
 }
@@ -268,8 +1043,35 @@ int main(int argc, char **argv)
   cfg.n_targetseq  = -1;
 
   process_commandline(argc, argv, &go, &cfg.hmmfile, &cfg.dbfile);    
+  simd_level = simd_Select(go);
+
+  //with --mpi every rank runs this whole program on its own shard of the target database.
+  //results are sent to rank 0 by the one thread that runs output_hmm_buffer, at most one at a time
+  oi.rank   = 0;
+  oi.nranks = 1;
+#ifdef HAVE_MPI
+  oi.mpi_buf    = NULL;
+  oi.mpi_nalloc = 0;
+  if (esl_opt_GetBoolean(go, "--mpi"))
+  {
+    int provided;
+
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_SERIALIZED, &provided);
+    if (provided < MPI_THREAD_SERIALIZED) p7_Fail("--mpi: the MPI library doesn't support calls from more than one thread\n");
+    MPI_Comm_rank(MPI_COMM_WORLD, &oi.rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &oi.nranks);
+  }
+#endif
 
-/* is the range restricted? */
+  /* is the range restricted? */
+  if (esl_opt_IsOn(go, "--restrictdb_stkey"))
+    if ((cfg.firstseq_key = esl_opt_GetString(go, "--restrictdb_stkey")) == NULL) p7_Fail("Failure capturing --restrictdb_stkey\n");
+  if (esl_opt_IsOn(go, "--restrictdb_n"))
+    cfg.n_targetseq = esl_opt_GetInteger(go, "--restrictdb_n");
+  if (cfg.n_targetseq != -1 && cfg.n_targetseq < 1)
+    p7_Fail("--restrictdb_n must be >= 1\n");
+  if (esl_opt_IsOn(go, "--restrictdb_shard") && esl_opt_GetInteger(go, "--restrictdb_shard") >= esl_opt_GetInteger(go, "--restrictdb_nshards"))
+    p7_Fail("--restrictdb_shard must be less than --restrictdb_nshards\n");
 
   oi.ofp = stdout;
   oi.afp = NULL;
@@ -280,19 +1082,21 @@ int main(int argc, char **argv)
   oi.go = go;
   
   P7_HMMFILE *hfp = NULL;
-  ESL_SQFILE *dbfp = NULL;
+  SEQ_SOURCE  src;
   P7_HMM *hmm = NULL;
   int dbfmt = eslSQFILE_UNKNOWN;
 
   int nquery = 0;
 
   int hstatus;
-  int sstatus;
 
   char             errbuf[eslERRBUFSIZE];
+  MEM_PLAN         plan;
 
+  plan.budget = 0.;
   if (esl_opt_GetBoolean(go, "--notextw")) oi.textw = 0;
   else                                     oi.textw = esl_opt_GetInteger(go, "--textw");
+  oi.noali = esl_opt_GetBoolean(go, "--noali") && ! esl_opt_IsOn(go, "-A");
 
   if (esl_opt_IsOn(go, "--tformat")) 
   {
@@ -300,15 +1104,77 @@ int main(int argc, char **argv)
     if (dbfmt == eslSQFILE_UNKNOWN) p7_Fail("%s is not a recognized sequence database file format\n", esl_opt_GetString(go, "--tformat"));
   }
 
-  /* Open the target sequence database */
-  status = esl_sqfile_Open(cfg.dbfile, dbfmt, p7_SEQDBENV, &dbfp);
-  if      (status == eslENOTFOUND) p7_Fail("Failed to open sequence file %s for reading\n",          cfg.dbfile);
-  else if (status == eslEFORMAT)   p7_Fail("Sequence file %s is empty or misformatted\n",            cfg.dbfile);
-  else if (status == eslEINVAL)    p7_Fail("Can't autodetect format of a stdin or .gz seqfile");
-  else if (status != eslOK)        p7_Fail("Unexpected error %d opening sequence file %s\n", status, cfg.dbfile);  
+  /* Open the target sequence database. a pre-digitized database from hpc_makeseqdb is recognized
+   * by its magic and mapped; anything else goes to the easel reader */
+  src.dbfp    = NULL;
+  src.map     = NULL;
+  src.fa      = NULL;
+  src.shard   = oi.rank;
+  src.nshards = oi.nranks;
+  src.nread   = 0;
+  src.firstkey = NULL;
+  src.limit    = -1;
+  src.taken    = 0;
+  src.sq       = NULL;
+  src.held     = FALSE;
+
+  //a job array shard is split again between the MPI ranks of the job
+  if (esl_opt_IsOn(go, "--restrictdb_shard"))
+  {
+    src.shard   = esl_opt_GetInteger(go, "--restrictdb_shard") * oi.nranks + oi.rank;
+    src.nshards = esl_opt_GetInteger(go, "--restrictdb_nshards") * oi.nranks;
+  }
+  if (seqdb_Open(cfg.dbfile, &src.map) == eslOK) ;
+  //stdin and compressed FASTA go to the chunked reader, which decompresses them itself. a format easel
+  //can't sniff in those has to be given with --tformat, and then easel reads it
+  else if (seqfile_IsStream(cfg.dbfile) && (dbfmt == eslSQFILE_UNKNOWN || dbfmt == eslSQFILE_FASTA) && ! esl_opt_GetBoolean(go, "--noparload") &&
+           fasta_Open(cfg.dbfile, &src.fa) == eslOK) ;
+  else
+  {
+    status = esl_sqfile_Open(cfg.dbfile, dbfmt, p7_SEQDBENV, &src.dbfp);
+    if      (status == eslENOTFOUND) p7_Fail("Failed to open sequence file %s for reading\n",          cfg.dbfile);
+    else if (status == eslEFORMAT)   p7_Fail("Sequence file %s is empty or misformatted\n",            cfg.dbfile);
+    else if (status == eslEINVAL)    p7_Fail("Can't autodetect format of a stdin or compressed seqfile that isn't FASTA; give it with --tformat\n");
+    else if (status != eslOK)        p7_Fail("Unexpected error %d opening sequence file %s\n", status, cfg.dbfile);  
+
+    //plain FASTA on a regular file gets the chunked parallel parser; easel still did the format detection
+    if (src.dbfp->format == eslSQFILE_FASTA && ! esl_opt_GetBoolean(go, "--noparload") && ! seqfile_IsStream(cfg.dbfile) && fasta_Open(cfg.dbfile, &src.fa) == eslOK)
+    {
+      esl_sqfile_Close(src.dbfp);
+      src.dbfp = NULL;
+    }
+  }
+  if (src.nshards > 1)
+  {
+    if      (src.map) seqdb_Shard(src.map, src.shard, src.nshards);
+    else if (src.fa)  fasta_Shard(src.fa,  src.shard, src.nshards);
+    else if (strcmp(cfg.dbfile, "-") == 0) p7_Fail("a sharded <seqdb> can't be read from stdin\n");
+  }
+  if (cfg.firstseq_key != NULL || cfg.n_targetseq != -1)
+  {
+    if (strcmp(cfg.dbfile, "-") == 0) p7_Fail("a restricted <seqdb> can't be read from stdin\n");
+    seq_source_Restrict(&src, cfg.firstseq_key, cfg.n_targetseq, esl_opt_GetString(go, "--ssifile"));
+  }
+
+  //only rank 0 writes anything; the other ranks send it their results. a daemon writes to its clients
+  if (oi.rank != 0 || esl_opt_IsOn(go, "--daemon")) oi.ofp = NULL;
+
+  //an interrupted run with the same arguments left a checkpoint: carry on after its last finished hmm buffer.
+  //every rank reads it, since they all skip the same models
+  CHECKPOINT ckpt;
+  oi.ckpt = NULL;
+  if (esl_opt_IsOn(go, "--checkpoint"))
+  {
+    ckpt.file    = esl_opt_GetString(go, "--checkpoint");
+    ckpt.args    = checkpoint_Hash(go);
+    ckpt.nmodels = 0;
+    ckpt.nquery  = 0;
+    checkpoint_Read(&ckpt);
+    oi.ckpt = &ckpt;
+  }
 
   //move this forward a bit so that the output_header has correct output file handle
-  if (esl_opt_IsOn(go, "-o"))          { if ((oi.ofp      = fopen(esl_opt_GetString(go, "-o"), "w")) == NULL) p7_Fail("Failed to open output file %s for writing\n",    esl_opt_GetString(go, "-o")); }
+  if (oi.rank == 0 && esl_opt_IsOn(go, "-o")) { if ((oi.ofp      = checkpoint_Open(oi.ckpt, OUT_MAIN, esl_opt_GetString(go, "-o"))) == NULL) p7_Fail("Failed to open output file %s for writing\n",    esl_opt_GetString(go, "-o")); }
 
   /* Open the query profile HMM file */
   status = p7_hmmfile_OpenE(cfg.hmmfile, NULL, &hfp, errbuf);
@@ -320,247 +1186,171 @@ int main(int argc, char **argv)
   if (hstatus == eslOK)
   {
     /* One-time initializations after alphabet <abc> becomes known */
-    output_header(oi.ofp, go, cfg.hmmfile, cfg.dbfile);
-    esl_sqfile_SetDigital(dbfp, oi.abc); //ReadBlock requires knowledge of the alphabet to decide how best to read blocks
+    if (esl_opt_IsOn(go, "--mem")) mem_Plan(&plan, go, &src, cfg.hmmfile, cfg.dbfile, dbfmt, oi.abc);
+    if (oi.ofp && ! (oi.ckpt && oi.ckpt->resume)) output_header(oi.ofp, go, cfg.hmmfile, cfg.dbfile, plan.budget > 0. ? &plan : NULL);
+    if      (src.dbfp) esl_sqfile_SetDigital(src.dbfp, oi.abc); //ReadBlock requires knowledge of the alphabet to decide how best to read blocks
+    else if (src.fa)   src.fa->abc = oi.abc;
+    else if (src.map->hdr->abc_type != oi.abc->type)
+      p7_Fail("Sequence database %s is %s but the HMMs are %s\n", cfg.dbfile, esl_abc_DecodeType(src.map->hdr->abc_type), esl_abc_DecodeType(oi.abc->type));
   }
   p7_hmmfile_Close(hfp);
   status = p7_hmmfile_OpenE(cfg.hmmfile, NULL, &hfp, errbuf);
   if(status != eslOK) p7_Fail("Reopening the hmm shouldn't have failed.\n");
+  if (oi.ckpt && oi.ckpt->resume)
+  {
+    skip_hmm_models(hfp, oi.ckpt->nmodels, oi.abc);
+    nquery = oi.ckpt->nquery;
+  }
 
   /* Open the results output files */
-  if (esl_opt_IsOn(go, "-A"))          { if ((oi.afp      = fopen(esl_opt_GetString(go, "-A"), "w")) == NULL) p7_Fail("Failed to open alignment file %s for writing\n", esl_opt_GetString(go, "-A")); }
-  if (esl_opt_IsOn(go, "--tblout"))    { if ((oi.tblfp    = fopen(esl_opt_GetString(go, "--tblout"),    "w")) == NULL)  esl_fatal("Failed to open tabular per-seq output file %s for writing\n", esl_opt_GetString(go, "--tblout")); }
-  if (esl_opt_IsOn(go, "--domtblout")) { if ((oi.domtblfp = fopen(esl_opt_GetString(go, "--domtblout"), "w")) == NULL)  esl_fatal("Failed to open tabular per-dom output file %s for writing\n", esl_opt_GetString(go, "--domtblout")); }
-  if (esl_opt_IsOn(go, "--pfamtblout")){ if ((oi.pfamtblfp = fopen(esl_opt_GetString(go, "--pfamtblout"), "w")) == NULL)  esl_fatal("Failed to open pfam-style tabular output file %s for writing\n", esl_opt_GetString(go, "--pfamtblout")); }
+  if (oi.rank == 0)
+  {
+    if (esl_opt_IsOn(go, "-A"))          { if ((oi.afp      = checkpoint_Open(oi.ckpt, OUT_ALI, esl_opt_GetString(go, "-A"))) == NULL) p7_Fail("Failed to open alignment file %s for writing\n", esl_opt_GetString(go, "-A")); }
+    if (esl_opt_IsOn(go, "--tblout"))    { if ((oi.tblfp    = checkpoint_Open(oi.ckpt, OUT_TBL, esl_opt_GetString(go, "--tblout"))) == NULL)  esl_fatal("Failed to open tabular per-seq output file %s for writing\n", esl_opt_GetString(go, "--tblout")); }
+    if (esl_opt_IsOn(go, "--domtblout")) { if ((oi.domtblfp = checkpoint_Open(oi.ckpt, OUT_DOMTBL, esl_opt_GetString(go, "--domtblout"))) == NULL)  esl_fatal("Failed to open tabular per-dom output file %s for writing\n", esl_opt_GetString(go, "--domtblout")); }
+    if (esl_opt_IsOn(go, "--pfamtblout")){ if ((oi.pfamtblfp = checkpoint_Open(oi.ckpt, OUT_PFAMTBL, esl_opt_GetString(go, "--pfamtblout"))) == NULL)  esl_fatal("Failed to open pfam-style tabular output file %s for writing\n", esl_opt_GetString(go, "--pfamtblout")); }
+  }
   
 
 int seq_buffer_size = esl_opt_GetInteger(go, "--seq_buffer");
+size_t seq_buffer_budget = (size_t) esl_opt_GetInteger(go, "--seq_buffer_mb") << 20;
 int hmm_buffer_size = esl_opt_GetInteger(go, "--hmm_buffer");
 int requested_threads = esl_opt_GetInteger(go, "--cpu");
+int seq_cache_mb = esl_opt_IsOn(go, "--seq_cache") ? esl_opt_GetInteger(go, "--seq_cache") : 0;
+if (plan.budget > 0.)
+{
+  if (! esl_opt_IsUsed(go, "--seq_buffer"))    seq_buffer_size   = plan.seq_buffer;
+  if (! esl_opt_IsUsed(go, "--seq_buffer_mb")) seq_buffer_budget = (size_t) plan.seq_mb << 20;
+  if (! esl_opt_IsUsed(go, "--hmm_buffer"))    hmm_buffer_size   = plan.hmm_buffer;
+  if (! esl_opt_IsUsed(go, "--seq_cache"))     seq_cache_mb      = plan.seq_cache;
+}
+//a mapped database is searched in place, so there is nothing to cache; easel can only seek in a plain file
+if (src.map) seq_cache_mb = 0;
+if (seq_cache_mb && src.dbfp && seqfile_IsStream(cfg.dbfile))
+  p7_Fail("--seq_cache needs to seek in <seqdb>, and easel can't in stdin or a compressed file (try without --noparload)\n");
 
 oi.threads = requested_threads;
+oi.pool    = work_pool_Create(requested_threads);
+int sched_mode = SCHED_TILES;
+if      (strcmp(esl_opt_GetString(go, "--sched"), "tiles") == 0) sched_mode = SCHED_TILES;
+else if (strcmp(esl_opt_GetString(go, "--sched"), "split") == 0) sched_mode = SCHED_SPLIT;
+else p7_Fail("--sched must be tiles or split\n");
+oi.stats = NULL;
+if ((esl_opt_IsOn(go, "--stats") && oi.rank == 0) || esl_opt_IsOn(go, "--trace"))
+{
+  FILE *sfp = NULL;
+  if (esl_opt_IsOn(go, "--stats") && oi.rank == 0 && (sfp = fopen(esl_opt_GetString(go, "--stats"), "w")) == NULL)
+    p7_Fail("Failed to open statistics file %s for writing\n", esl_opt_GetString(go, "--stats"));
+  oi.stats = stats_Create(sfp, requested_threads);
+  if (esl_opt_IsOn(go, "--trace")) trace_Create(oi.stats, esl_opt_GetString(go, "--trace"), oi.rank, oi.nranks);
+}
+if (src.fa && src.fa->z) src.fa->z->stats = oi.stats;
+oi.numa = NULL;
+if (esl_opt_GetBoolean(go, "--numa"))
+{
+  if (sched_mode != SCHED_TILES) p7_Fail("--numa needs the tile scheduler\n");
+  oi.numa = numa_Create(requested_threads);
+}
+
+  if (esl_opt_GetBoolean(go, "--bench_load"))
+  {
+    benchmark_loaders(cfg.dbfile, dbfmt, oi.abc, seq_buffer_size, seq_buffer_budget, requested_threads, oi.ofp);
+    exit(0);
+  }
 
 //now build some data structures to contain the data buffers
 
-// prepare the sequence block buffer
-// The aim is to alternate between flip and flop. one buffer is being read from file
-// while the second is being processed.
+// the sequence buffers: a ring of them, so several can be loaded or searched at the same time
+  int a, i;
+  SEQ_RING *ring = seq_ring_Create(&src, esl_opt_GetInteger(go, "--seq_ring"), seq_buffer_size, seq_buffer_budget, esl_opt_GetBoolean(go, "--seq_sort"), oi.abc,
+                                   requested_threads, sched_mode, oi.numa);
+  oi.sched = ring->ts[0];   //the benchmarks run a single block on this one
+  for(a = 0; a < ring->nts; a++) ring->ts[a]->stats = oi.stats;
+  if (plan.budget > 0.) for(a = 0; a < ring->nts; a++) ring->ts[a]->per_thread = plan.tiles;
+  //a daemon keeps all of the database it can, unless told how much
+  size_t seq_cache_cap = seq_cache_mb ? (size_t) seq_cache_mb << 20 : (esl_opt_IsOn(go, "--daemon") && ! src.map ? SIZE_MAX : 0);
+  SEQ_CACHE *cache = seq_cache_cap ? seq_cache_Create(seq_cache_cap, ring->nslots, seq_buffer_size, seq_buffer_budget,
+                                                      esl_opt_GetBoolean(go, "--seq_sort"), oi.abc, oi.numa) : NULL;
 
-  ESL_SQ **sbb_flip     = NULL, **sbb_flop     = NULL;
 
-  ESL_ALLOC(sbb_flip     , sizeof(ESL_SQ*) * seq_buffer_size);
-  ESL_ALLOC(sbb_flop     , sizeof(ESL_SQ*) * seq_buffer_size);
+ //build the hmm buffer blocks: one is searched while the other is written out and refilled
+  HMM_SET     hset[2];
+  HMM_BUFFER *hb_mem[2] = { NULL, NULL };
+  HMM_SET    *cur = hset;
 
-  int a;
-  for(a = 0; a < seq_buffer_size; a++)
+  for(i = 0; i < 2; i++)
   {
-    sbb_flip[a] = esl_sq_CreateDigital(oi.abc);
-    sbb_flop[a] = esl_sq_CreateDigital(oi.abc); 
-  }
+    ESL_ALLOC(hset[i].hb, sizeof(HMM_BUFFER*) * hmm_buffer_size);
+    ESL_ALLOC(hb_mem[i],  sizeof(HMM_BUFFER ) * hmm_buffer_size);
+    hset[i].refs    = 0;
+    hset[i].loading = 0;
+    hset[i].hstatus = eslOK;
 
- //build the hmm buffer blocks
-  HMM_BUFFER **hb_flip     = NULL, **hb_flop     = NULL;
-  HMM_BUFFER  *hb_flip_mem = NULL,  *hb_flop_mem = NULL;
+    for(a = 0; a < hmm_buffer_size; a++)
+    {
+      HMM_BUFFER *hb = hset[i].hb[a] = hb_mem[i] + a;
 
-  ESL_ALLOC(hb_flip    , sizeof(HMM_BUFFER*) * hmm_buffer_size);
-  ESL_ALLOC(hb_flop    , sizeof(HMM_BUFFER*) * hmm_buffer_size);
-  ESL_ALLOC(hb_flip_mem, sizeof(HMM_BUFFER ) * hmm_buffer_size);
-  ESL_ALLOC(hb_flop_mem, sizeof(HMM_BUFFER ) * hmm_buffer_size);
+      hb->pli = NULL;
+      hb->th  = NULL;
+      hb->om  = NULL;
+      hb->bg  = NULL;
 
-  for(a = 0; a < hmm_buffer_size; a++)
-  {
-    hb_flip[a] = hb_flip_mem + a;
-    hb_flop[a] = hb_flop_mem + a;
+      if ((hb->th_part  = calloc(requested_threads, sizeof(P7_TOPHITS *))) == NULL) goto ERROR;
+      if ((hb->cnt_part = calloc(requested_threads, sizeof(PLI_COUNTS)))   == NULL) goto ERROR;
 
-    hb_flip[a]->pli = NULL; 
-    hb_flip[a]->th  = NULL;
-    hb_flip[a]->om  = NULL;
-    hb_flip[a]->bg  = NULL;  
-    hb_flop[a]->pli = NULL;
-    hb_flop[a]->th  = NULL;
-    hb_flop[a]->om  = NULL;
-    hb_flop[a]->bg  = NULL;
+      hb->trace_name = -1;
+      hb->topk    = esl_opt_IsOn(go, "--top_k") ? topk_Create(esl_opt_GetInteger(go, "--top_k")) : NULL;
+      hb->nnodes  = oi.numa ? oi.numa->nnodes : 0;
+      hb->om_node = NULL;
+      if (hb->nnodes && (hb->om_node = calloc(hb->nnodes, sizeof(P7_OPROFILE *))) == NULL) goto ERROR;
+    }
   }
 
-  //first step: prime the pipeline by reading the first seq buffer and the first hmm buffer into flip
-  #pragma omp parallel num_threads(requested_threads)
+  if (esl_opt_GetBoolean(go, "--bench_sched"))
   {
-    //this single thread serializes high level control flow decisions such as when to flip buffers
-    //and when to load/process buffers. I tried a few other arrangements (involving shared loop control variables) but kept getting
-    //threads leaking through loop conditionals, stuck on the wrong barriers, and hanging the program
-    #pragma omp single
+    #pragma omp parallel num_threads(requested_threads)
     {
-      //load first seq buffer/ta
-      #pragma omp task
-      { sstatus = load_seq_buffer(dbfp, sbb_flip, seq_buffer_size); }
-      //load the first hmm buffer
-      #pragma omp task
-      { hstatus = load_hmm_buffer(hfp, hb_flip, &nquery, hmm_buffer_size, oi.abc, go); }
-
-      // do not proceed until the flip buffers have their first inputs ready
-      #pragma omp taskwait 
-
-      //special case when the entire seq db fits in one buffer. Skip reading any more from seq file and skip flipping seq buffers.
-      //remember we're in the single control thread scope so this is not a shared control variable
-      int stabilize_seq = 0;
-      if(sstatus == eslEOF) stabilize_seq = 1;
-
-      while(hstatus == eslOK) //while we have not yet encountered a partially full model buffer, iterate the pipeline thorugh another model buffer
-      {
-        //two steps to prepare the next hmm buffer: output results currently in flop (unless this is the first iteration), then
-        //read the next portion of the hmm file into flop
-        #pragma omp task 
-        {
-          if(hb_flop[0]->om != NULL) //this bails if this is the first iteration before anything has been processed
-          { output_hmm_buffer(hb_flop, hmm_buffer_size, nquery, &oi); }
-
-          hstatus = load_hmm_buffer(hfp, hb_flop, &nquery, hmm_buffer_size, oi.abc, go);
-        }
-
-        do //this is the sequence buffer loop. do at least once (where the initial load was a partial and sstatus is now eslEOF)
-        {
-          //this taskgroup encloses an entire work block including child tasks spawned by load balancing inside the work kernel
-          #pragma omp taskgroup
-          {
-            //flip contains entire seqdb, don't bother with seq flop
-            if(stabilize_seq == 0);
-            {
-              #pragma omp task 
-              { sstatus = load_seq_buffer(dbfp, sbb_flop, seq_buffer_size); }
-            }
-
-            work_counter = 0;
-            //now create the tasks for the currenty body of work which is every hmm in flip buffer X every block in seq flip buffer
-            int hb_idx;
-            for(hb_idx = 0; hb_idx < hmm_buffer_size; hb_idx++)
-            {  
-              #pragma omp atomic
-              work_counter++;
-              #pragma omp task 
-              { 
-                thread_kernel(hb_flip[hb_idx], sbb_flip, 0, seq_buffer_size, go, &oi); 
-              }
-            }
-          }
-          //task group acts as barrier on the preparation of the next seq buffer and the completion of all work units
-
-          if(stabilize_seq == 0)
-          {
-            ESL_SQ **temp = sbb_flip;
-            sbb_flip = sbb_flop;
-            sbb_flop = temp;
-          } 
-        } while(sstatus != eslEOF);
-
-        //now do a final iteration of the seq buffer loop. this will load the first block of the next pass through the seq buffer
-        //and process the last seq buffer of the current model buffer
-
-        if(stabilize_seq == 0) //if one seq buffer holds all sequences, then we're already done
-        {
-          //work block task group
-          #pragma omp taskgroup
-          {
-            #pragma omp task 
-            { sstatus = load_seq_buffer(dbfp, sbb_flop, seq_buffer_size); }
-
-            int hb_idx;
-            work_counter = 0;
-            for(hb_idx = 0; hb_idx < hmm_buffer_size; hb_idx++)
-            {
-              #pragma omp atomic
-              work_counter++;
-              #pragma omp task 
-              { 
-                thread_kernel(hb_flip[hb_idx], sbb_flip, 0, seq_buffer_size, go, &oi); 
-              }
-            }
-          } //task group barrier to complete work block
-
-          if(stabilize_seq == 0)
-          {
-            ESL_SQ **temp = sbb_flip;
-            sbb_flip = sbb_flop;
-            sbb_flop = temp;
-          }
-        }
-
-        //this taskwait catches the unlikely situation where all processing is completed before
-        //the hmm buffer loading task is finished
-        #pragma omp taskwait 
- 
-        HMM_BUFFER **temp = hb_flip;
-        hb_flip = hb_flop;
-        hb_flop = temp;
-      } 
-      //back down to the scope of the single control thread
-
-      //output of the last full buffer of models 
-      #pragma omp task
+      numa_Pin(oi.numa);
+      #pragma omp single
       {
-        output_hmm_buffer(hb_flop, hmm_buffer_size, nquery, &oi);
+        load_seq_buffer(&src, ring->slot[0].sb);
+        load_hmm_buffer(hfp, cur->hb, &nquery, hmm_buffer_size, oi.abc, go);
       }
+    }
+    benchmark_sched(cur->hb, hmm_buffer_size, ring->slot[0].sb, go, &oi, oi.ofp);
+    exit(0);
+  }
 
-      //if hmm_buffer_size evenly divides the number of models, then the final "partial" buffer is actually empty
-      //and this setion can be completely skipped
-      if(hb_flip[0]->om != NULL)
+  if (esl_opt_GetBoolean(go, "--bench_msv"))
+  {
+#ifdef HAVE_MSV_BATCH
+    #pragma omp parallel num_threads(requested_threads)
+    {
+      numa_Pin(oi.numa);
+      #pragma omp single
       {
-        //process the final partially full hmm buffer in flip
-        do
-        {
-          //work block task group
-          #pragma omp taskgroup
-          {
-            #pragma omp task 
-            {
-              if(stabilize_seq == 0)
-                sstatus = load_seq_buffer(dbfp, sbb_flop, seq_buffer_size);
-            }
-
-            int hb_idx;
-            work_counter = 0;
-            for(hb_idx = 0; hb_idx < hmm_buffer_size; hb_idx++)
-            {
-              #pragma omp atomic
-              work_counter++;
-              #pragma omp task 
-              {
-                thread_kernel(hb_flip[hb_idx], sbb_flip, 0, seq_buffer_size, go, &oi); 
-              }
-            }
-          }
-
-          if(stabilize_seq == 0)
-          {
-            ESL_SQ **temp = sbb_flip;
-            sbb_flip = sbb_flop;
-            sbb_flop = temp;
-          } 
-        } while(sstatus != eslEOF);
-
-        if(stabilize_seq == 0)
-        {
-          //work block task group
-          #pragma omp taskgroup
-          {
-            int hb_idx;
-            work_counter = 0;
-            for(hb_idx = 0; hb_idx < hmm_buffer_size; hb_idx++)
-            {
-              #pragma omp atomic
-              work_counter++;
-              #pragma omp task
-              { 
-                thread_kernel(hb_flip[hb_idx], sbb_flip, 0, seq_buffer_size, go, &oi); 
-              }
-            }
-          } //final work block task group barrier
-        }
-      } 
-    } //end single control thread
-  } //end parallel region
+        load_seq_buffer(&src, ring->slot[0].sb);
+        load_hmm_buffer(hfp, cur->hb, &nquery, hmm_buffer_size, oi.abc, go);
+      }
+    }
+    benchmark_msv(cur->hb, hmm_buffer_size, ring->slot[0].sb, oi.ofp);
+    exit(0);
+#else
+    p7_Fail("--bench_msv: this build has no batched MSV filter (it needs SSSE3)\n");
+#endif
+  }
 
-  //finally, write the output for the work on the partial hmm buffer
-  output_hmm_buffer(hb_flip, hmm_buffer_size, nquery, &oi);
+  if (esl_opt_IsOn(go, "--daemon"))
+    daemon_Serve(esl_opt_GetString(go, "--daemon"), hset, hmm_buffer_size, ring, cache, &src, cfg.dbfile, go, &oi);
+  else
+    search_models(hfp, hset, hmm_buffer_size, &nquery, ring, cache, &src, go, &oi);
+  if (oi.numa) numa_Report(oi.numa, requested_threads, stderr);
+  if (oi.stats)
+  {
+    if (oi.stats->fp)    stats_Write(oi.stats, &oi);
+    if (oi.stats->trace) trace_Write(oi.stats);
+    stats_Destroy(oi.stats);
+  }
 
   /* Terminate outputs... any last words?
    */
@@ -570,23 +1360,32 @@ oi.threads = requested_threads;
   if (oi.ofp)      { if (fprintf(oi.ofp, "[ok]\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed"); }
   esl_getopts_Destroy(go);
 
-  free(hb_flip); free(hb_flip_mem);
-  free(hb_flop); free(hb_flop_mem);
-
-  for(a = 0; a < seq_buffer_size; a++)
+  for(i = 0; i < 2; i++)
   {
-    esl_sq_Destroy(sbb_flip[a]);
-    esl_sq_Destroy(sbb_flop[a]);
+    for(a = 0; a < hmm_buffer_size; a++) { free(hset[i].hb[a]->th_part); free(hset[i].hb[a]->cnt_part); free(hset[i].hb[a]->om_node); topk_Destroy(hset[i].hb[a]->topk); }
+    free(hset[i].hb); free(hb_mem[i]);
   }
-  free(sbb_flip);
-  free(sbb_flop);
 
-  if (oi.ofp != stdout) fclose(oi.ofp);
+  seq_ring_Destroy(ring);
+  seq_cache_Destroy(cache);
+  numa_Destroy(oi.numa);
+  work_pool_Destroy(oi.pool, oi.threads);
+  if (src.map)  seqdb_Close(src.map);
+  if (src.fa)   fasta_Close(src.fa);
+  esl_sq_Destroy(src.sq);
+
+  if (oi.ofp && oi.ofp != stdout) fclose(oi.ofp);
   if (oi.afp)           fclose(oi.afp);
   if (oi.tblfp)         fclose(oi.tblfp);
   if (oi.domtblfp)      fclose(oi.domtblfp);
   if (oi.pfamtblfp)     fclose(oi.pfamtblfp);
+  if (oi.ckpt && oi.rank == 0) remove(oi.ckpt->file);   //the run is complete; a rerun starts over
 
+#ifdef HAVE_MPI
+  int mpi_on;
+  MPI_Initialized(&mpi_on);
+  if (mpi_on) { free(oi.mpi_buf); MPI_Finalize(); }
+#endif
   return eslOK;
 
 ERROR:
@@ -594,168 +1393,4069 @@ ERROR:
   return eslOK;
 }
 
-//load a number of sequences from the file into the given sequence buffer
-//if the end of file is hit, the remaining block space is 0 length sequences (what esl_sq_Reuse makes)
-//return eslOK if the entire seq buffer holds new data and there could be more in the file
-//if the seq buffer was not filled because EOF, then reset its position to the
-//start and return eslEOF
-static int load_seq_buffer(ESL_SQFILE *dbfp, ESL_SQ **sbb, int seq_per_buffer)
+//map a pre-digitized database written by hpc_makeseqdb
+//returns eslEFORMAT if the file can't be opened or is not one of ours, so the caller can
+//fall back to the easel reader; a file that has our magic but is damaged is a fatal error
+static int seqdb_Open(const char *dbfile, SEQDB_MAP **ret_map)
 {
-  int x, y;
-  int sstatus = eslOK;
-  static int count = 0;
+  SEQDB_MAP  *map = NULL;
+  struct stat st;
+  char        magic[HPC_SEQDB_MAGICLEN];
+  int         fd;
+  int         status;
 
-  for(x = 0; x < seq_per_buffer; x++)
+  *ret_map = NULL;
+  if ((fd = open(dbfile, O_RDONLY)) < 0) return eslEFORMAT;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size < (off_t) sizeof(HPC_SEQDB_HEADER) ||
+      pread(fd, magic, HPC_SEQDB_MAGICLEN, 0) != HPC_SEQDB_MAGICLEN || memcmp(magic, HPC_SEQDB_MAGIC, HPC_SEQDB_MAGICLEN) != 0)
   {
-    esl_sq_Reuse(sbb[x]);
-    if((sstatus = esl_sqio_Read(dbfp, sbb[x])) == eslOK)
-      count++;
+    close(fd);
+    return eslEFORMAT;
   }
 
-  switch(sstatus)
+  ESL_ALLOC(map, sizeof(SEQDB_MAP));
+  map->fd   = fd;
+  map->size = st.st_size;
+  map->next = 0;
+  if ((map->base = mmap(NULL, map->size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED)
+    p7_Fail("Failed to map sequence database %s\n", dbfile);
+
+  map->hdr = (HPC_SEQDB_HEADER *) map->base;
+  if (map->hdr->version == (uint32_t) HPC_SEQDB_VERSION << 24)   //byte-swapped; holds while versions are below 256
+    p7_Fail("Sequence database %s was written on a machine of the other byte order; rebuild it with hpc_makeseqdb\n", dbfile);
+  if (map->hdr->version != HPC_SEQDB_VERSION)
+    p7_Fail("Sequence database %s is format version %u, expected %u; rebuild it with hpc_makeseqdb\n", dbfile, map->hdr->version, HPC_SEQDB_VERSION);
+  if (map->hdr->res_offset + map->hdr->res_size                         > map->size ||
+      map->hdr->idx_offset + map->hdr->nseq * sizeof(HPC_SEQDB_ENTRY)  > map->size ||
+      map->hdr->str_offset + map->hdr->str_size                         > map->size)
+    p7_Fail("Sequence database %s is truncated\n", dbfile);
+
+  map->res = (ESL_DSQ *)         ((char *) map->base + map->hdr->res_offset);
+  map->idx = (HPC_SEQDB_ENTRY *) ((char *) map->base + map->hdr->idx_offset);
+  map->str =                      (char *) map->base + map->hdr->str_offset;
+  map->first = 0;
+  map->last  = map->hdr->nseq;
+
+  *ret_map = map;
+  return eslOK;
+
+ERROR:
+  close(fd);
+  return status;
+}
+
+static void seqdb_Close(SEQDB_MAP *map)
+{
+  if (map == NULL) return;
+  munmap(map->base, map->size);
+  close(map->fd);
+  free(map);
+}
+
+//restrict the mapping to shard <shard> of <nshards>. shards are cut by residue count, not by
+//sequence count, so each rank gets about the same amount of work
+static void seqdb_Shard(SEQDB_MAP *map, int shard, int nshards)
+{
+  uint64_t bound[2];
+  int      b;
+
+  for(b = 0; b < 2; b++)
   {
-    case eslEFORMAT: fprintf(stderr, "Parse failed (sequence file %s):\n%s\n", dbfp->filename, esl_sqfile_GetErrorBuf(dbfp)); exit(0); break;
-    case eslEOF    :
-      count = 0;
-      int s = esl_sqfile_Position(dbfp, 0);
-      if(s != eslOK)
-        p7_Fail("Failure rewinding sequence file\n");
+    uint64_t target = map->hdr->res_size / nshards * (shard + b) + map->hdr->res_size % nshards * (shard + b) / nshards;
+    uint64_t lo = 0, hi = map->hdr->nseq;
+
+    //first sequence whose residues start at or after target; the index is in file order
+    while(lo < hi)
+    {
+      uint64_t mid = lo + (hi - lo) / 2;
+      if(map->idx[mid].dsq_off < target) lo = mid + 1;
+      else                               hi = mid;
+    }
+    bound[b] = (shard + b == nshards) ? map->hdr->nseq : lo;
+  }
+
+  map->first = map->next = bound[0];
+  map->last  = bound[1];
+}
+
+//fill a buffer with index records of the mapping; nothing is copied but the records.
+//eslEOF once the last sequence has been handed out
+static int load_seqdb_buffer(SEQDB_MAP *map, SEQ_BUFFER *sb, int want)
+{
+  uint64_t first = map->next;
+  size_t   used  = 0;
+
+  sb->res = map->res;
+  sb->str = map->str;
+  while(sb->count < want && map->next < map->last)
+  {
+    HPC_SEQDB_ENTRY *e = map->idx + map->next;
+
+    if(sb->count > 0 && used + e->len + 1 > sb->budget) break;
+    sb->rec[sb->count++] = *e;
+    used += e->len + 1;
+    map->next++;
+  }
+
+  //ask the kernel to start paging in this buffer's residues while the previous one is computed on
+  if(map->next > first)
+  {
+    long   pagesz = sysconf(_SC_PAGESIZE);
+    char  *lo     = (char *) (map->res + map->idx[first].dsq_off);
+    char  *hi     = (char *) (map->res + map->idx[map->next-1].dsq_off + map->idx[map->next-1].len + 2);
+    char  *lo_pg  = (char *) ((uintptr_t) lo & ~((uintptr_t) pagesz - 1));
+    posix_madvise(lo_pg, hi - lo_pg, POSIX_MADV_WILLNEED);
+  }
+
+  return (map->next == map->last) ? eslEOF : eslOK;
+}
+
+static void zsrc_AddBlock(ZSRC *z, off_t coff, off_t uoff, size_t ulen)
+{
+  ZBLOCK *b;
+
+  if (z->nblk == z->balloc)
+  {
+    z->balloc = ESL_MAX(64, 2 * z->balloc);
+    if ((z->blk = realloc(z->blk, sizeof(ZBLOCK) * z->balloc)) == NULL) goto ERROR;
+  }
+  b = z->blk + z->nblk++;
+  b->coff   = coff;
+  b->uoff   = uoff;
+  b->ulen   = ulen;
+  b->bits   = 0;
+  b->wlen   = 0;
+  b->window = NULL;
+  return;
+
+ERROR:
+  p7_Fail("Failed to allocate the block index of %s\n", z->name);
+}
+
+#ifdef HAVE_ZLIB
+//a gzip access point at the inflater's position, which is between two deflate blocks
+static void zsrc_AddPoint(ZSRC *z)
+{
+  ZBLOCK *b;
+  uInt    wlen = ZSRC_WINDOW;
+
+  zsrc_AddBlock(z, z->cin + z->inpos, z->uout, 0);
+  b       = z->blk + z->nblk - 1;
+  b->bits = z->zs.data_type & 7;
+  if ((b->window = malloc(ZSRC_WINDOW)) == NULL) goto ERROR;
+  if (inflateGetDictionary(&z->zs, b->window, &wlen) != Z_OK) p7_Fail("Failed to save a gzip access point\n");
+  b->wlen = wlen;
+  return;
+
+ERROR:
+  p7_Fail("Failed to allocate a gzip access point\n");
+}
+#endif
+
+//the size of the bgzip member at p: a gzip header with a BC extra subfield that holds it. 0 if it isn't one
+static size_t bgzf_MemberSize(const unsigned char *p, size_t n)
+{
+  size_t xlen, i;
+
+  if (n < 28 || p[0] != 0x1f || p[1] != 0x8b || p[2] != 8 || ! (p[3] & 4)) return 0;
+  xlen = p[10] | p[11] << 8;
+  for (i = 12; i + 4 <= 12 + xlen && i + 6 <= n; i += 4 + (p[i+2] | p[i+3] << 8))
+    if (p[i] == 'B' && p[i+1] == 'C' && (p[i+2] | p[i+3] << 8) == 2) return (size_t) (p[i+4] | p[i+5] << 8) + 1;
+  return 0;
+}
+
+//index a mapped file from its headers alone: every member must be a bgzip member, or every zstd frame must
+//record its content size. eslEFORMAT otherwise, and the first pass builds the index instead
+static int zsrc_IndexHeaders(ZSRC *z)
+{
+  size_t off = 0;
+  off_t  u   = 0;
+
+  while (off < z->csize)
+  {
+    const unsigned char *p = z->map + off;
+    size_t               c = 0;
+    uint64_t             n = 0;
+
+    if (z->codec == ZSRC_GZIP)
+    {
+      if ((c = bgzf_MemberSize(p, z->csize - off)) == 0 || c > z->csize - off) break;
+      n = (uint64_t) p[c-4] | (uint64_t) p[c-3] << 8 | (uint64_t) p[c-2] << 16 | (uint64_t) p[c-1] << 24;
+    }
+#ifdef HAVE_ZSTD
+    else if (z->codec == ZSRC_ZSTD)
+    {
+      unsigned long long s = ZSTD_getFrameContentSize(p, z->csize - off);
+
+      c = ZSTD_findFrameCompressedSize(p, z->csize - off);
+      if (ZSTD_isError(c) || s == ZSTD_CONTENTSIZE_UNKNOWN || s == ZSTD_CONTENTSIZE_ERROR) break;
+      n = s;
+    }
+#endif
+    else break;
+    zsrc_AddBlock(z, off, u, n);
+    off += c;
+    u   += n;
+  }
+  if (off < z->csize)
+  {
+    z->nblk = 0;
+    return eslEFORMAT;
+  }
+  z->usize   = u;
+  z->indexed = TRUE;
+  return eslOK;
+}
+
+//the next compressed bytes for the serial decoder: from the file or stdin (copied to the spool) on the first
+//pass, from the map after it
+static size_t zsrc_Refill(ZSRC *z)
+{
+  ssize_t n;
+
+  z->cin  += z->inlen;
+  z->inlen = z->inpos = 0;
+  if (z->indexed)
+  {
+    n = (ssize_t) ESL_MIN((size_t) ZSRC_IN, z->csize - (size_t) z->cin);
+    memcpy(z->in, z->map + z->cin, n);
+  }
+  else
+  {
+    while ((n = read(z->fd, z->in, ZSRC_IN)) < 0)
+      if (errno != EINTR) p7_Fail("Failed reading sequence file %s\n", z->name);
+    if (n > 0 && z->spool && fwrite(z->in, 1, n, z->spool) != (size_t) n) p7_Fail("Failed to write the spool file of %s\n", z->name);
+  }
+  z->inlen = n;
+  return n;
+}
+
+//decompress up to <want> bytes at the serial decoder's position. on the first pass each member or frame start,
+//and a gzip access point at the first deflate block boundary ZSRC_SPAN past the last block, goes in the index
+static size_t zsrc_Stream(ZSRC *z, unsigned char *dst, size_t want)
+{
+  size_t got = 0, n;
+
+  while (got < want && ! z->done)
+  {
+    if (z->inpos == z->inlen && zsrc_Refill(z) == 0)
+    {
+      if (! z->at_start) p7_Fail("Sequence file %s is truncated\n", z->name);
+      z->done = TRUE;
       break;
-    case eslOK    : /* do nothing */ break;
-    default       : fprintf(stderr, "Unexpected error %d reading sequence file %s", sstatus, dbfp->filename); exit(0);
+    }
+    switch (z->codec)
+    {
+      case ZSRC_NONE:
+        n = ESL_MIN(want - got, z->inlen - z->inpos);
+        memcpy(dst + got, z->in + z->inpos, n);
+        z->inpos += n;
+        got      += n;
+        z->uout  += n;
+        break;
+#ifdef HAVE_ZLIB
+      case ZSRC_GZIP:
+      {
+        size_t avail = ESL_MIN(want - got, (size_t) UINT_MAX);
+        int    ret;
+
+        if (z->at_start)
+        {
+          if (! z->indexed) zsrc_AddBlock(z, z->cin + z->inpos, z->uout, 0);
+          if (inflateReset2(&z->zs, 31) != Z_OK) p7_Fail("Failed to reset the gzip decoder\n");
+          z->at_start = FALSE;
+        }
+        z->zs.next_in   = z->in + z->inpos;
+        z->zs.avail_in  = z->inlen - z->inpos;
+        z->zs.next_out  = dst + got;
+        z->zs.avail_out = avail;
+        ret = inflate(&z->zs, Z_BLOCK);
+        n         = avail - z->zs.avail_out;
+        got      += n;
+        z->uout  += n;
+        z->inpos  = z->inlen - z->zs.avail_in;
+        if      (ret == Z_STREAM_END) z->at_start = TRUE;
+        else if (ret != Z_OK && ret != Z_BUF_ERROR) p7_Fail("Sequence file %s: corrupt gzip data (%s)\n", z->name, z->zs.msg ? z->zs.msg : "inflate failed");
+        else if (! z->indexed && (z->zs.data_type & 128) && ! (z->zs.data_type & 64) && z->uout - z->blk[z->nblk-1].uoff >= ZSRC_SPAN)
+          zsrc_AddPoint(z);
+        break;
+      }
+#endif
+#ifdef HAVE_ZSTD
+      case ZSRC_ZSTD:
+      {
+        ZSTD_inBuffer  zi = { z->in, z->inlen, z->inpos };
+        ZSTD_outBuffer zo = { dst + got, want - got, 0 };
+        size_t         r;
+
+        if (z->at_start && ! z->indexed) zsrc_AddBlock(z, z->cin + z->inpos, z->uout, 0);
+        z->at_start = FALSE;
+        if (ZSTD_isError(r = ZSTD_decompressStream(z->zd, &zo, &zi))) p7_Fail("Sequence file %s: corrupt zstd data (%s)\n", z->name, ZSTD_getErrorName(r));
+        z->inpos = zi.pos;
+        got     += zo.pos;
+        z->uout += zo.pos;
+        if (r == 0) z->at_start = TRUE;
+        break;
+      }
+#endif
+    }
+  }
+  return got;
+}
+
+//the first pass is over: map the compressed bytes and close the index
+static void zsrc_Finish(ZSRC *z)
+{
+  struct stat st;
+  int         fd = z->spool ? fileno(z->spool) : z->fd;
+  int         k;
+
+  if (z->spool && fflush(z->spool) != 0) p7_Fail("Failed to write the spool file of %s\n", z->name);
+  if (fstat(fd, &st) != 0) p7_Fail("Failed to stat sequence file %s\n", z->name);
+  if (z->map == NULL && st.st_size > 0)
+  {
+    z->csize = st.st_size;
+    if ((z->map = mmap(NULL, z->csize, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) p7_Fail("Failed to map the compressed bytes of %s\n", z->name);
+  }
+  z->usize = z->uout;
+  for (k = 0; k < z->nblk; k++) z->blk[k].ulen = ((k + 1 < z->nblk) ? z->blk[k+1].uoff : z->usize) - z->blk[k].uoff;
+  z->indexed = TRUE;
+}
+
+//read the stream to its end, when the whole index is wanted before the first pass has run
+static void zsrc_Index(ZSRC *z)
+{
+
+  if (z->indexed) return;
+  if (z->oalloc < ZSRC_IN)
+  {
+    if ((z->out = realloc(z->out, ZSRC_IN)) == NULL) goto ERROR;
+    z->oalloc = ZSRC_IN;
+  }
+  while (zsrc_Stream(z, z->out, ZSRC_IN) > 0) ;
+  z->olen = 0;
+  zsrc_Finish(z);
+  return;
+
+ERROR:
+  p7_Fail("Failed to allocate a decompression buffer\n");
+}
+
+//the last block that starts at or before uncompressed offset <off>
+static int zsrc_Find(const ZSRC *z, off_t off)
+{
+  int lo = 0, hi = z->nblk - 1;
+
+  while (lo < hi)
+  {
+    int mid = (lo + hi + 1) / 2;
+    if (z->blk[mid].uoff <= off) lo = mid;
+    else                         hi = mid - 1;
+  }
+  return lo;
+}
+
+//decompress block k, on its own, into dst
+static void zsrc_Block(const ZSRC *z, int k, unsigned char *dst)
+{
+  const ZBLOCK *b = z->blk + k;
+
+  if (b->ulen == 0) return;
+  switch (z->codec)
+  {
+#ifdef HAVE_ZLIB
+    case ZSRC_GZIP:
+    {
+      z_stream s;
+      size_t   c = b->coff;
+      int      ret;
+
+      memset(&s, 0, sizeof(s));
+      if (inflateInit2(&s, b->window ? -15 : 31) != Z_OK) p7_Fail("Failed to create a gzip decoder\n");
+      if (b->window)
+      {
+        if (b->bits) inflatePrime(&s, b->bits, z->map[c-1] >> (8 - b->bits));
+        inflateSetDictionary(&s, b->window, b->wlen);
+      }
+      s.next_out  = dst;
+      s.avail_out = b->ulen;
+      while (s.avail_out > 0)
+      {
+        if (s.avail_in == 0)
+        {
+          size_t n = ESL_MIN(z->csize - c, (size_t) 1 << 30);
+          if (n == 0) p7_Fail("Sequence file %s is truncated\n", z->name);
+          s.next_in  = z->map + c;
+          s.avail_in = n;
+          c         += n;
+        }
+        ret = inflate(&s, Z_NO_FLUSH);
+        if      (ret == Z_STREAM_END && s.avail_out > 0) inflateReset2(&s, 31);   //the block ran on into the next member
+        else if (ret != Z_OK && ret != Z_STREAM_END) p7_Fail("Sequence file %s: corrupt gzip data (%s)\n", z->name, s.msg ? s.msg : "inflate failed");
+      }
+      inflateEnd(&s);
+      break;
+    }
+#endif
+#ifdef HAVE_ZSTD
+    case ZSRC_ZSTD:
+    {
+      ZSTD_DCtx *dc  = ZSTD_createDCtx();
+      size_t     end = (k + 1 < z->nblk) ? (size_t) z->blk[k+1].coff : z->csize;
+      size_t     r;
+
+      if (dc == NULL) p7_Fail("Failed to create a zstd decoder\n");
+      r = ZSTD_decompressDCtx(dc, dst, b->ulen, z->map + b->coff, end - b->coff);
+      if (ZSTD_isError(r) || r != b->ulen) p7_Fail("Sequence file %s: corrupt zstd frame at byte %lld\n", z->name, (long long) b->coff);
+      ZSTD_freeDCtx(dc);
+      break;
+    }
+#endif
+    default:
+      memcpy(dst, z->map + b->coff, b->ulen);
+  }
+}
+
+//decompress the blocks from k on, as many as fit in <limit> bytes (but at least block k), with a task per
+//ZSRC_GRAIN of them
+static void zsrc_Batch(ZSRC *z, int k, size_t limit)
+{
+  size_t n = 0;
+  int    e = k, x, y;
+
+  while (e < z->nblk && (e == k || n + z->blk[e].ulen <= limit)) n += z->blk[e++].ulen;
+  if (n > z->oalloc)
+  {
+    if ((z->out = realloc(z->out, n)) == NULL) goto ERROR;
+    z->oalloc = n;
+  }
+  for (x = k; x < e; x = y)
+  {
+    size_t g = 0;
+    for (y = x; y < e && (y == x || g < ZSRC_GRAIN); y++) g += z->blk[y].ulen;
+
+    #pragma omp task firstprivate(x, y)
+    {
+      int b;
+      for (b = x; b < y; b++) zsrc_Block(z, b, z->out + (z->blk[b].uoff - z->blk[k].uoff));
+    }
+  }
+  #pragma omp taskwait
+
+  z->ostart = z->blk[k].uoff;
+  z->olen   = n;
+  return;
+
+ERROR:
+  p7_Fail("Failed to allocate %zu bytes for decompression\n", n);
+}
+
+//put the serial decoder at the start of block k
+static void zsrc_Restart(ZSRC *z, int k)
+{
+  const ZBLOCK *b = z->blk + k;
+
+  z->cin      = b->coff;
+  z->inlen    = z->inpos = 0;
+  z->uout     = b->uoff;
+  z->done     = FALSE;
+  z->at_start = TRUE;
+#ifdef HAVE_ZLIB
+  if (z->codec == ZSRC_GZIP && b->window)
+  {
+    if (inflateReset2(&z->zs, -15) != Z_OK) p7_Fail("Failed to reset the gzip decoder\n");
+    if (b->bits) inflatePrime(&z->zs, b->bits, z->map[b->coff-1] >> (8 - b->bits));
+    inflateSetDictionary(&z->zs, b->window, b->wlen);
+    z->at_start = FALSE;
+  }
+#endif
+#ifdef HAVE_ZSTD
+  if (z->codec == ZSRC_ZSTD) ZSTD_DCtx_reset(z->zd, ZSTD_reset_session_only);
+#endif
+}
+
+//up to <want> bytes from the current position; 0 at the end of the stream
+static size_t zsrc_Read(ZSRC *z, char *dst, size_t want)
+{
+  unsigned char *d = (unsigned char *) dst;
+  size_t         n = 0;
+  double         t[2];
+  int            k;
+
+  if (z->upos >= z->ostart && z->upos < z->ostart + (off_t) z->olen)
+  {
+    n = ESL_MIN(want, (size_t) (z->ostart + z->olen - z->upos));
+    memcpy(d, z->out + (z->upos - z->ostart), n);
+    z->upos += n;
+    return n;
+  }
+
+  stats_Start(z->stats, t);
+  if (! z->indexed)
+  {
+    if ((n = zsrc_Stream(z, d, want)) == 0) zsrc_Finish(z);
+  }
+  else if (z->upos >= z->usize) n = 0;
+  else if (z->codec == ZSRC_NONE)
+  {
+    n = ESL_MIN(want, (size_t) (z->usize - z->upos));
+    memcpy(d, z->map + z->upos, n);
+  }
+  else if (z->blk[k = zsrc_Find(z, z->upos)].ulen <= ZSRC_BATCH)
+  {
+    zsrc_Batch(z, k, z->batch);
+    n = ESL_MIN(want, (size_t) (z->ostart + z->olen - z->upos));
+    memcpy(d, z->out + (z->upos - z->ostart), n);
+  }
+  else
+  {
+    off_t end = z->blk[k].uoff + z->blk[k].ulen;
+
+    if (z->uout != z->upos || z->done)
+    {
+      zsrc_Restart(z, k);
+      while (z->uout < z->upos)
+        if (zsrc_Stream(z, d, ESL_MIN(want, (size_t) (z->upos - z->uout))) == 0) p7_Fail("Sequence file %s is truncated\n", z->name);
+    }
+    n = zsrc_Stream(z, d, ESL_MIN(want, (size_t) (end - z->upos)));
+  }
+  z->upos += n;
+  stats_Stop(z->stats, ST_DECOMP, t);
+  return n;
+}
+
+//a rewind, or a jump to a shard boundary. one that isn't to the current position indexes the whole stream first
+static void zsrc_Seek(ZSRC *z, off_t off)
+{
+  if (! z->indexed && off != z->upos) zsrc_Index(z);
+  z->upos = off;
+}
+
+//a read at <off> that leaves the position alone. it decompresses one block, not a batch: the record scans
+//of fasta_Shard only want a few bytes at each end of a shard
+static size_t zsrc_Pread(ZSRC *z, char *dst, size_t want, off_t off)
+{
+  off_t  save = z->upos;
+  size_t n;
+
+  zsrc_Seek(z, off);
+  z->batch = 0;
+  n = zsrc_Read(z, dst, want);
+  z->batch = ZSRC_BATCH;
+  zsrc_Seek(z, save);
+  return n;
+}
+
+static off_t zsrc_Size(ZSRC *z)
+{
+  zsrc_Index(z);
+  return z->usize;
+}
+
+static void zsrc_Close(ZSRC *z)
+{
+  int k;
+
+  if (z == NULL) return;
+  for (k = 0; k < z->nblk; k++) free(z->blk[k].window);
+  free(z->blk);
+  free(z->in);
+  free(z->out);
+  if (z->map) munmap(z->map, z->csize);
+  if (z->spool) fclose(z->spool);
+#ifdef HAVE_ZLIB
+  if (z->codec == ZSRC_GZIP) inflateEnd(&z->zs);
+#endif
+#ifdef HAVE_ZSTD
+  if (z->zd) ZSTD_freeDStream(z->zd);
+#endif
+  close(z->fd);
+  free(z);
+}
+
+//compressed bytes from fd, or anything from stdin: the codec is told by the magic at the start. a regular file
+//is mapped and indexed from its headers if it can be. eslEFORMAT for a compressed regular file this build has no
+//decoder for, which easel's reader gets instead
+static int zsrc_Open(int fd, int regular, const char *name, ZSRC **ret_z)
+{
+  ZSRC       *z = NULL;
+  struct stat st;
+  ssize_t     n;
+  int         status;
+
+  ESL_ALLOC(z, sizeof(ZSRC));
+  memset(z, 0, sizeof(ZSRC));
+  z->name     = name;
+  z->fd       = fd;
+  z->at_start = TRUE;
+  z->batch    = ZSRC_BATCH;
+  ESL_ALLOC(z->in, ZSRC_IN);
+  if (! regular && (z->spool = tmpfile()) == NULL) p7_Fail("Failed to create a spool file for %s\n", name);
+
+  //the first bytes, for the magic. they stay in the buffer for the serial decoder
+  while (z->inlen < 4 && (n = read(fd, z->in + z->inlen, ZSRC_IN - z->inlen)) != 0)
+  {
+    if (n < 0) { if (errno == EINTR) continue; p7_Fail("Failed reading sequence file %s\n", name); }
+    if (z->spool && fwrite(z->in + z->inlen, 1, n, z->spool) != (size_t) n) p7_Fail("Failed to write the spool file of %s\n", name);
+    z->inlen += n;
+  }
+  if      (z->inlen >= 2 && z->in[0] == 0x1f && z->in[1] == 0x8b)                                           z->codec = ZSRC_GZIP;
+  else if (z->inlen >= 4 && z->in[0] == 0x28 && z->in[1] == 0xb5 && z->in[2] == 0x2f && z->in[3] == 0xfd) z->codec = ZSRC_ZSTD;
+  else if (regular) { status = eslEFORMAT; goto ERROR; }
+  else                                                                                                     z->codec = ZSRC_NONE;
+  if (z->codec == ZSRC_NONE) zsrc_AddBlock(z, 0, 0, 0);
+
+#ifdef HAVE_ZLIB
+  if (z->codec == ZSRC_GZIP && inflateInit2(&z->zs, 31) != Z_OK) p7_Fail("Failed to create a gzip decoder\n");
+#else
+  if (z->codec == ZSRC_GZIP) { if (regular) { status = eslEFORMAT; goto ERROR; } p7_Fail("%s is gzip compressed; build with -DHAVE_ZLIB to read it from stdin\n", name); }
+#endif
+#ifdef HAVE_ZSTD
+  if (z->codec == ZSRC_ZSTD && (z->zd = ZSTD_createDStream()) == NULL) p7_Fail("Failed to create a zstd decoder\n");
+#else
+  if (z->codec == ZSRC_ZSTD) { if (regular) { status = eslEFORMAT; goto ERROR; } p7_Fail("%s is zstd compressed; build with -DHAVE_ZSTD to read it from stdin\n", name); }
+#endif
+
+  if (regular && fstat(fd, &st) == 0 && st.st_size > 0)
+  {
+    z->csize = st.st_size;
+    if ((z->map = mmap(NULL, z->csize, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) p7_Fail("Failed to map %s\n", name);
+    zsrc_IndexHeaders(z);
+  }
+  *ret_z = z;
+  return eslOK;
+
+ERROR:
+  if (z) { free(z->in); free(z); }
+  return status;
+}
+
+//stdin, or a file that starts with gzip or zstd magic: easel can't tell the format of these, and would
+//decompress the whole file again on every pass
+static int seqfile_IsStream(const char *dbfile)
+{
+  unsigned char magic[4];
+  struct stat   st;
+  int           fd, n;
+
+  if (strcmp(dbfile, "-") == 0) return TRUE;
+  if ((fd = open(dbfile, O_RDONLY)) < 0) return FALSE;
+  n = (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) ? pread(fd, magic, 4, 0) : 0;
+  close(fd);
+  return (n >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) ||
+         (n == 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd);
+}
+
+//open a FASTA file for the chunked reader: a regular file, a compressed one or stdin (through a ZSRC).
+//eslEFORMAT if it can't be opened that way, and it stays with the easel reader
+static int fasta_Open(const char *dbfile, FASTA_READER **ret_fa)
+{
+  FASTA_READER *fa = NULL;
+  struct stat   st;
+  int           fd;
+  int           status;
+
+  *ret_fa = NULL;
+  if      (strcmp(dbfile, "-") == 0)             fd = STDIN_FILENO;
+  else if ((fd = open(dbfile, O_RDONLY)) < 0)    return eslEFORMAT;
+  if (fstat(fd, &st) != 0) { close(fd); return eslEFORMAT; }
+
+  ESL_ALLOC(fa, sizeof(FASTA_READER));
+  fa->fd       = fd;
+  fa->z        = NULL;
+  fa->filename = NULL;
+  fa->abc      = NULL;
+  fa->buf      = NULL;
+  fa->nbuf     = 0;
+  fa->balloc   = 0;
+  fa->foff     = 0;
+  fa->start    = 0;
+  fa->stop     = st.st_size;
+  fa->eof      = 0;
+  fa->rec      = NULL;
+  fa->ralloc   = 0;
+  if (esl_strdup(dbfile, -1, &fa->filename) != eslOK) goto ERROR;
+
+  if (seqfile_IsStream(dbfile))
+  {
+    if ((status = zsrc_Open(fd, S_ISREG(st.st_mode), fa->filename, &fa->z)) != eslOK)
+    {
+      close(fd);
+      free(fa->filename);
+      free(fa);
+      return status;
+    }
+    fa->stop = INT64_MAX;   //the uncompressed size isn't known until the end
+  }
+  else if (S_ISREG(st.st_mode)) posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  else
+  {
+    close(fd);
+    free(fa->filename);
+    free(fa);
+    return eslEFORMAT;
+  }
+
+  *ret_fa = fa;
+  return eslOK;
+
+ERROR:
+  close(fd);
+  if (fa) free(fa);
+  return eslEMEM;
+}
+
+static void fasta_Close(FASTA_READER *fa)
+{
+  if (fa == NULL) return;
+  if (fa->z) zsrc_Close(fa->z);
+  else       close(fa->fd);
+  free(fa->filename);
+  free(fa->buf);
+  free(fa->rec);
+  free(fa);
+}
+
+//<off> must be the start of a record
+static void fasta_Seek(FASTA_READER *fa, off_t off)
+{
+  if      (fa->z) zsrc_Seek(fa->z, off);
+  else if (lseek(fa->fd, off, SEEK_SET) != off) p7_Fail("Failure repositioning sequence file\n");
+  fa->nbuf = 0;
+  fa->foff = off;
+  fa->eof  = 0;
+}
+
+static void fasta_Rewind(FASTA_READER *fa)
+{
+  fasta_Seek(fa, fa->start);
+}
+
+static ssize_t fasta_Pread(FASTA_READER *fa, char *buf, size_t n, off_t off)
+{
+  return fa->z ? (ssize_t) zsrc_Pread(fa->z, buf, n, off) : pread(fa->fd, buf, n, off);
+}
+
+//the offset of the first record that starts at or after <off>: a '>' at the start of a line
+static off_t fasta_NextRecord(FASTA_READER *fa, off_t off)
+{
+  char    buf[65536];
+  char    prev = '\n';
+  ssize_t n, i;
+
+  if (off <= 0) return 0;
+  if (fasta_Pread(fa, &prev, 1, off - 1) != 1) p7_Fail("Failed reading sequence file %s\n", fa->filename);
+  while ((n = fasta_Pread(fa, buf, sizeof(buf), off)) > 0)
+  {
+    for (i = 0; i < n; i++)
+    {
+      if (buf[i] == '>' && prev == '\n') return off + i;
+      prev = buf[i];
+    }
+    off += n;
+  }
+  if (n < 0) p7_Fail("Failed reading sequence file %s\n", fa->filename);
+  return off;
+}
+
+//restrict the reader to the records that start in shard <shard> of <nshards> equal byte ranges.
+//each end is moved forward to a record start, so neighbouring shards meet exactly
+static void fasta_Shard(FASTA_READER *fa, int shard, int nshards)
+{
+  struct stat st;
+  off_t       size = 0;
+
+  if      (fa->z) size = zsrc_Size(fa->z);
+  else if (fstat(fa->fd, &st) != 0) p7_Fail("Failed to stat sequence file %s\n", fa->filename);
+  else    size = st.st_size;
+
+  fa->start = fasta_NextRecord(fa, size / nshards * shard       + size % nshards * shard       / nshards);
+  fa->stop  = fasta_NextRecord(fa, size / nshards * (shard + 1) + size % nshards * (shard + 1) / nshards);
+  fasta_Rewind(fa);
+}
+
+//append the next chunk of the file to buf. also asks for the chunk after it to be read ahead,
+//so the disk stays busy while this one is scanned and parsed. compressed input comes a batch of blocks at a time
+//from zsrc_Read instead
+static void fasta_Fill(FASTA_READER *fa)
+{
+  ssize_t n;
+  size_t  want;
+
+  if (fa->nbuf + FASTA_CHUNK > fa->balloc)
+  {
+    fa->balloc = fa->nbuf + FASTA_CHUNK;
+    if ((fa->buf = realloc(fa->buf, fa->balloc)) == NULL) goto ERROR;
+  }
+
+  //never read past the end of the range
+  want = (size_t) ESL_MIN((off_t) FASTA_CHUNK, fa->stop - (fa->foff + (off_t) fa->nbuf));
+
+  if (fa->z) n = (want > 0) ? (ssize_t) zsrc_Read(fa->z, fa->buf + fa->nbuf, want) : 0;
+  else
+    while ((n = (want > 0) ? read(fa->fd, fa->buf + fa->nbuf, want) : 0) < 0)
+      if (errno != EINTR) p7_Fail("Failed reading sequence file %s\n", fa->filename);
+  if (n == 0) fa->eof = 1;
+  else
+  {
+    fa->nbuf += n;
+    if (! fa->z) posix_fadvise(fa->fd, fa->foff + fa->nbuf, FASTA_CHUNK, POSIX_FADV_WILLNEED);
+  }
+  return;
+
+ERROR:
+  p7_Fail("Failed to allocate %zu bytes for sequence file buffer\n", fa->balloc);
+}
+
+//a parsed record takes at most its own bytes plus this much of the arena: two sentinels and three string
+//terminators, less the '>' and the newline that every record has
+#define FASTA_REC_SLACK 4
+
+//locate the starts of up to <want> records whose arena reservations fit in <maxbytes> (a first record
+//always fits), reading more of the file as needed. on return rec[0..nrec-1] are record starts and rec[nrec]
+//is the end of the last one. *more is FALSE once the records run out
+static int fasta_FindRecords(FASTA_READER *fa, int want, size_t maxbytes, int *more)
+{
+  size_t scan = 0;
+  int    nrec = 0;
+
+  if (fa->ralloc < want + 1)
+  {
+    if ((fa->rec = realloc(fa->rec, sizeof(size_t) * (want + 1))) == NULL) goto ERROR;
+    fa->ralloc = want + 1;
+  }
+  *more = TRUE;
+
+  while (1)
+  {
+    char *q = (scan < fa->nbuf) ? memchr(fa->buf + scan, '>', fa->nbuf - scan) : NULL;
+
+    if (q != NULL)
+    {
+      size_t i = q - fa->buf;
+      scan = i + 1;
+      if (i > 0 && fa->buf[i-1] != '\n') continue;      //a '>' inside a line is just text
+
+      if (nrec == 0 && fa->foff == 0)                     //only whitespace may precede the first record
+      {
+        size_t j;
+        for (j = 0; j < i; j++)
+          if (! isspace((unsigned char) fa->buf[j])) p7_Fail("Sequence file %s is not in FASTA format\n", fa->filename);
+      }
+      fa->rec[nrec++] = i;
+      //records 0..nrec-2 are complete now; drop the last of them if it overflows the arena
+      if (nrec > 2 && fa->rec[nrec-1] - fa->rec[0] + FASTA_REC_SLACK * (nrec - 1) > maxbytes) return nrec - 2;
+      if (nrec == want + 1) return want;                  //the next record's start ends the last one we keep
+    }
+    else if (! fa->eof) fasta_Fill(fa);
+    else
+    {
+      fa->rec[nrec] = fa->nbuf;
+      if (nrec > 1 && fa->rec[nrec] - fa->rec[0] + FASTA_REC_SLACK * nrec > maxbytes) return nrec - 1;
+      *more = FALSE;
+      return nrec;
+    }
+  }
+
+ERROR:
+  p7_Fail("Failed to allocate record index\n");
+  return 0;
+}
+
+//digitize one record, buf[s..e), into record y of the buffer at arena offset <off>, the way the easel FASTA
+//parser would: name is the first word of the header line, desc the rest of it, whitespace in the sequence is
+//skipped. the residues go first, so the strings are copied after them from the raw buffer
+static void fasta_ParseRecord(FASTA_READER *fa, size_t s, size_t e, SEQ_BUFFER *sb, int y, size_t off)
+{
+  const char      *p     = fa->buf + s + 1;
+  const char      *end   = fa->buf + e;
+  const char      *name, *desc;
+  int              lname, ldesc = 0;
+  ESL_DSQ         *dsq   = (ESL_DSQ *) sb->arena + off;
+  HPC_SEQDB_ENTRY *r     = sb->rec + y;
+  char            *c;
+  int64_t          n     = 0;
+
+  while (p < end && (*p == ' ' || *p == '\t')) p++;
+  for (name = p; p < end && ! isspace((unsigned char) *p); p++) ;
+  if ((lname = p - name) == 0) p7_Fail("Parse failed (sequence file %s): a FASTA record at byte %lld has no name\n", fa->filename, (long long) (fa->foff + s));
+
+  while (p < end && (*p == ' ' || *p == '\t')) p++;
+  for (desc = p; p < end && *p != '\n'; p++) ;
+  if (p > desc)
+  {
+    const char *d = p;
+    while (d > desc && isspace((unsigned char) d[-1])) d--;
+    ldesc = d - desc;
+  }
+
+  for (; p < end; p++)
+  {
+    unsigned char ch = *p;
+    ESL_DSQ       x  = (ch < 128) ? fa->abc->inmap[ch] : eslDSQ_ILLEGAL;
+
+    if      (esl_abc_XIsValid(fa->abc, x)) dsq[++n] = x;
+    else if (isspace(ch))                  continue;
+    else p7_Fail("Parse failed (sequence file %s): illegal character '%c' in sequence %.*s\n", fa->filename, *p, lname, name);
+  }
+  dsq[0]   = eslDSQ_SENTINEL;
+  dsq[n+1] = eslDSQ_SENTINEL;
+
+  c = (char *) (dsq + n + 2);
+  r->dsq_off  = off;
+  r->len      = n;
+  r->name_off = c - sb->arena;  memcpy(c, name, lname); c[lname] = '\0'; c += lname + 1;
+  r->acc_off  = c - sb->arena;  *c++ = '\0';
+  r->desc_off = c - sb->arena;  memcpy(c, desc, ldesc); c[ldesc] = '\0';
+}
+
+//same contract as the easel path of load_seq_buffer. the record scan is serial (it is a memchr),
+//the parse and digitize is split over tasks. every record gets its own byte count plus FASTA_REC_SLACK
+//of the arena, so the tasks know where to write without waiting for each other
+static int load_fasta_buffer(FASTA_READER *fa, SEQ_BUFFER *sb, int want)
+{
+  int    more  = FALSE;
+  int    nrec  = fasta_FindRecords(fa, want, sb->budget, &more);
+  int    grain = ESL_MAX(64, nrec / (4 * omp_get_num_threads()) + 1);
+  size_t used;
+  int    x;
+
+  seq_buffer_Reserve(sb, fa->rec[nrec] - fa->rec[0] + FASTA_REC_SLACK * nrec);
+  for(x = 0; x < nrec; x += grain)
+  {
+    #pragma omp task firstprivate(x)
+    {
+      int y;
+      for(y = x; y < x + grain && y < nrec; y++)
+        fasta_ParseRecord(fa, fa->rec[y], fa->rec[y+1], sb, y, fa->rec[y] - fa->rec[0] + FASTA_REC_SLACK * y);
+    }
+  }
+  #pragma omp taskwait
+
+  sb->count = nrec;
+  sb->aused = fa->rec[nrec] - fa->rec[0] + FASTA_REC_SLACK * nrec;
+  if(! more) return eslEOF;
+
+  //keep the unparsed tail; it starts at a record boundary
+  used = fa->rec[nrec];
+  memmove(fa->buf, fa->buf + used, fa->nbuf - used);
+  fa->nbuf -= used;
+  fa->foff += used;
+  return eslOK;
+}
+
+//read the next sequences from a file easel understands, each copied into the arena. a shard reads past
+//the sequences that belong to the other shards. a sequence that doesn't fit is held for the next buffer
+static int load_easel_buffer(SEQ_SOURCE *src, SEQ_BUFFER *sb, int want)
+{
+  ESL_SQFILE *dbfp    = src->dbfp;
+  int         sstatus = eslOK;
+
+  if(src->sq == NULL && (src->sq = esl_sq_CreateDigital(sb->abc)) == NULL) p7_Fail("Failed to allocate a sequence\n");
+  while(sb->count < want)
+  {
+    if(! src->held)
+    {
+      esl_sq_Reuse(src->sq);
+      while((sstatus = esl_sqio_Read(dbfp, src->sq)) == eslOK && src->nread++ % src->nshards != (uint64_t) src->shard)
+        esl_sq_Reuse(src->sq);
+      if(sstatus != eslOK) break;
+    }
+    if((src->held = ! seq_buffer_Append(sb, src->sq->dsq, src->sq->n, src->sq->name, src->sq->acc, src->sq->desc))) break;
+  }
+
+  switch(sstatus)
+  {
+    case eslEFORMAT: fprintf(stderr, "Parse failed (sequence file %s):\n%s\n", dbfp->filename, esl_sqfile_GetErrorBuf(dbfp)); exit(0); break;
+    case eslEOF    : /* load_seq_buffer rewinds */ break;
+    case eslOK    : /* do nothing */ break;
+    default       : fprintf(stderr, "Unexpected error %d reading sequence file %s", sstatus, dbfp->filename); exit(0);
+  }
+  return sstatus;
+}
+
+static int seq_length_cmp(const void *a, const void *b)
+{
+  uint64_t na = ((const HPC_SEQDB_ENTRY *) a)->len;
+  uint64_t nb = ((const HPC_SEQDB_ENTRY *) b)->len;
+  return (na > nb) - (na < nb);
+}
+
+//put a source back at the start of its slice (the start of the file when unrestricted)
+static void seq_source_Rewind(SEQ_SOURCE *src)
+{
+  if      (src->map) src->map->next = src->map->first;   //rewinding a mapping is free
+  else if (src->fa)  fasta_Rewind(src->fa);
+  else
+  {
+    //like hmmsearch, look the key up again each pass rather than remembering an offset
+    if ((src->firstkey ? esl_sqfile_PositionByKey(src->dbfp, src->firstkey) : esl_sqfile_Position(src->dbfp, 0)) != eslOK)
+      p7_Fail("Failure rewinding sequence file\n");
+    src->nread = 0;
+  }
+  src->taken = 0;
+  src->held  = FALSE;
+}
+
+//where the next load starts. easel's offsets are of records already read, so an easel source reads the next
+//one ahead and holds it, as if it hadn't fit in the last buffer
+static void seq_source_Tell(SEQ_SOURCE *src, SEQ_POS *pos)
+{
+  int sstatus = eslOK;
+
+  pos->taken = src->taken;
+  pos->nread = src->nread;
+  if      (src->map) pos->off = (off_t) src->map->next;
+  else if (src->fa)  pos->off = src->fa->foff;
+  else
+  {
+    if(src->sq == NULL && (src->sq = esl_sq_CreateDigital(src->dbfp->abc)) == NULL) p7_Fail("Failed to allocate a sequence\n");
+    if(! src->held)
+    {
+      esl_sq_Reuse(src->sq);
+      while((sstatus = esl_sqio_Read(src->dbfp, src->sq)) == eslOK && src->nread++ % src->nshards != (uint64_t) src->shard)
+        esl_sq_Reuse(src->sq);
+      src->held = (sstatus == eslOK);   //anything else, the load that follows reports or rewinds
+    }
+    pos->nread = src->nread - 1;
+    pos->off   = src->held ? src->sq->roff : -1;
+  }
+}
+
+static void seq_source_Seek(SEQ_SOURCE *src, const SEQ_POS *pos)
+{
+  if      (src->map) src->map->next = (uint64_t) pos->off;
+  else if (src->fa)  fasta_Seek(src->fa, pos->off);
+  else
+  {
+    if (esl_sqfile_Position(src->dbfp, pos->off) != eslOK) p7_Fail("Failure repositioning sequence file\n");
+    src->nread = pos->nread;
+  }
+  src->taken = pos->taken;
+  src->held  = FALSE;
+}
+
+//restrict a source to the slice of <limit> sequences (-1 for all) starting at the one named <firstkey>
+//(NULL for the first one). text files find the key through their SSI index (esl-sfetch --index),
+//so the start of the slice is a seek, not a scan. an hpc_makeseqdb database has no name index;
+//its index records are scanned once here
+static void seq_source_Restrict(SEQ_SOURCE *src, char *firstkey, int64_t limit, char *ssifile)
+{
+  src->firstkey = firstkey;
+  src->limit    = limit;
+
+  if (firstkey != NULL)
+  {
+    if (src->map)
+    {
+      uint64_t i;
+
+      for (i = 0; i < src->map->hdr->nseq; i++)
+        if (strcmp(src->map->str + src->map->idx[i].name_off, firstkey) == 0) break;
+      if (i == src->map->hdr->nseq) p7_Fail("Failure setting restrictdb_stkey to %s: no such sequence\n", firstkey);
+      src->map->first = i;
+    }
+    else if (src->fa)
+    {
+      ESL_SSI *ssi   = NULL;
+      char    *name  = NULL;
+      uint16_t fh;
+      off_t    roff;
+
+      if (ssifile == NULL && esl_sprintf(&name, "%s.ssi", src->fa->filename) != eslOK) p7_Fail("allocation failed\n");
+      if (src->fa->z) p7_Fail("--restrictdb_stkey needs an uncompressed <seqdb>\n");
+      if (esl_ssi_Open(ssifile ? ssifile : name, &ssi) != eslOK)
+        p7_Fail("--restrictdb_stkey needs an SSI index of %s (esl-sfetch --index); failed to open %s\n", src->fa->filename, ssifile ? ssifile : name);
+      if (esl_ssi_FindName(ssi, firstkey, &fh, &roff, NULL, NULL) != eslOK)
+        p7_Fail("Failure setting restrictdb_stkey to %s\n", firstkey);
+      src->fa->start = roff;
+      esl_ssi_Close(ssi);
+      free(name);
+    }
+    else if (esl_sqfile_OpenSSI(src->dbfp, ssifile) != eslOK)
+      p7_Fail("--restrictdb_stkey needs an SSI index of %s (esl-sfetch --index)\n", src->dbfp->filename);
+  }
+
+  seq_source_Rewind(src);
+}
+
+//load a number of sequences from the file into the given sequence buffer: up to sb->size of them,
+//and no more than fit in sb->budget bytes (a single bigger sequence still gets a buffer to itself)
+//return eslOK if there could be more in the file
+//if the seq buffer holds the last sequences of the file, reset the position to the
+//start and return eslEOF
+//
+//the end of a --restrictdb slice counts as the end of file, and "the start" is the start of the slice
+//
+//with sb->sort the records are put in length order: neighbouring sequences then share a
+//length configuration in the kernel, and equal residue splits of a range are similar in cost.
+//hit reporting doesn't depend on the order
+static int load_seq_buffer(SEQ_SOURCE *src, SEQ_BUFFER *sb)
+{
+  int want = sb->size;
+  int sstatus;
+  int x;
+
+  if(src->limit >= 0 && src->limit - src->taken < want) want = src->limit - src->taken;
+
+  sb->count = 0;
+  sb->aused = 0;
+  if     (src->map) sstatus = load_seqdb_buffer(src->map, sb, want);
+  else if(src->fa)  sstatus = load_fasta_buffer(src->fa,  sb, want);
+  else              sstatus = load_easel_buffer(src,      sb, want);
+
+  src->taken += sb->count;
+  if(src->limit >= 0 && src->taken >= src->limit) sstatus = eslEOF;   //the slice ends in this buffer
+  if(sstatus == eslEOF) seq_source_Rewind(src);
+
+  seq_buffer_Slice(sb);
+  if(sb->sort)
+    for(x = 0; x < sb->nslices; x++)
+      qsort(sb->rec + sb->slice[x], sb->slice[x+1] - sb->slice[x], sizeof(HPC_SEQDB_ENTRY), seq_length_cmp);
+
+  sb->res_sum[0] = 0;
+  for(x = 0; x < sb->count; x++)
+    sb->res_sum[x+1] = sb->res_sum[x] + sb->rec[x].len;
+
+  return sstatus;
+}
+
+//make room for <need> more bytes in the arena. past the budget only for a sequence that has a buffer to itself,
+//and only between loads, so nothing holds on to the old address
+static void seq_buffer_Reserve(SEQ_BUFFER *sb, size_t need)
+{
+
+  if(sb->aused + need <= sb->asize) return;
+  sb->asize = sb->aused + need;
+  if ((sb->arena = realloc(sb->arena, sb->asize)) == NULL) goto ERROR;
+  sb->res = (ESL_DSQ *) sb->arena;
+  sb->str = sb->arena;
+  return;
+
+ERROR:
+  p7_Fail("Failed to allocate %zu bytes for a sequence buffer\n", sb->asize);
+}
+
+//copy a digital sequence and its strings to the end of the arena as the next record. FALSE if it would
+//go over the budget and the buffer already has something in it
+static int seq_buffer_Append(SEQ_BUFFER *sb, const ESL_DSQ *dsq, int64_t n, const char *name, const char *acc, const char *desc)
+{
+  size_t           lname = strlen(name) + 1;
+  size_t           lacc  = strlen(acc)  + 1;
+  size_t           ldesc = strlen(desc) + 1;
+  size_t           need  = n + 2 + lname + lacc + ldesc;
+  HPC_SEQDB_ENTRY *r     = sb->rec + sb->count;
+  size_t           off   = sb->aused;
+
+  if(sb->count > 0 && off + need > sb->budget) return FALSE;
+  seq_buffer_Reserve(sb, need);
+
+  memcpy(sb->arena + off, dsq, n + 2);    //dsq[0..n+1], both sentinels
+  r->dsq_off  = off;
+  r->len      = n;
+  r->name_off = off + n + 2;          memcpy(sb->arena + r->name_off, name, lname);
+  r->acc_off  = r->name_off + lname;  memcpy(sb->arena + r->acc_off,  acc,  lacc);
+  r->desc_off = r->acc_off  + lacc;   memcpy(sb->arena + r->desc_off, desc, ldesc);
+  sb->aused  += need;
+  sb->count++;
+  return TRUE;
+}
+
+//--numa: cut the loaded records into one slice per node. records in an arena belong to the node that
+//touched the memory they were parsed into; a mapped database's are cut by residues, in proportion to abound
+static void seq_buffer_Slice(SEQ_BUFFER *sb)
+{
+  uint64_t total = 0, pos = 0;
+  int      k, x;
+
+  sb->slice[0]           = 0;
+  sb->slice[sb->nslices] = sb->count;
+  if(sb->nslices == 1) return;
+
+  if(sb->arena == NULL) for(x = 0; x < sb->count; x++) total += sb->rec[x].len;
+  for(k = 1, x = 0; k < sb->nslices; k++)
+  {
+    uint64_t bound = sb->arena ? sb->abound[k] : total * sb->abound[k] / sb->abound[sb->nslices];
+
+    while(x < sb->count && (sb->arena ? sb->rec[x].dsq_off : pos) < bound) pos += sb->rec[x++].len;
+    sb->slice[k] = x;
+  }
+}
+
+//the kernels' view of record x: an ESL_SQ that owns nothing, pointing into the arena or the mapping.
+//sq was zeroed and given its alphabet once, by the caller
+static void seq_View(const SEQ_BUFFER *sb, int x, ESL_SQ *sq)
+{
+  const HPC_SEQDB_ENTRY *e = sb->rec + x;
+
+  sq->dsq   = sb->res + e->dsq_off;
+  sq->n     = e->len;
+  sq->name  = sb->str + e->name_off;
+  sq->acc   = sb->str + e->acc_off;
+  sq->desc  = sb->str + e->desc_off;
+  sq->start = 1;
+  sq->end   = sq->L = sq->W = sq->n;
+  sq->C     = 0;
+  sq->idx   = x;
+}
+
+//with --numa each thread first touches its share of the arena, so every node's part of it is local.
+//a mapped database needs no arena: its records point into the mapping
+static SEQ_BUFFER *seq_buffer_Create(SEQ_SOURCE *src, int size, size_t budget, int sort, ESL_ALPHABET *abc, NUMA_INFO *numa)
+{
+  SEQ_BUFFER *sb = NULL;
+  int         k;
+
+  if ((sb = malloc(sizeof(SEQ_BUFFER))) == NULL) goto ERROR;
+  sb->arena   = NULL;
+  sb->res     = NULL;
+  sb->str     = NULL;
+  sb->asize   = 0;
+  sb->aused   = 0;
+  sb->budget  = budget;
+  sb->abc     = abc;
+  sb->count   = 0;
+  sb->size    = size;
+  sb->sort    = sort;
+  sb->nslices = numa ? numa->nnodes : 1;
+  if ((sb->rec     = malloc(sizeof(HPC_SEQDB_ENTRY) * size)) == NULL) goto ERROR;
+  if ((sb->res_sum = malloc(sizeof(int64_t) * (size + 1))) == NULL) goto ERROR;
+  if ((sb->slice   = malloc(sizeof(int) * (sb->nslices + 1))) == NULL) goto ERROR;
+  if ((sb->abound  = malloc(sizeof(size_t) * (sb->nslices + 1))) == NULL) goto ERROR;
+  sb->res_sum[0] = 0;
+  sb->slice[0]   = sb->slice[sb->nslices] = 0;
+  if(src->map == NULL)
+  {
+    if ((sb->arena = malloc(budget)) == NULL) goto ERROR;
+    sb->asize = budget;
+    sb->res   = (ESL_DSQ *) sb->arena;
+    sb->str   = sb->arena;
+  }
+  for(k = 0; k <= sb->nslices; k++)
+    sb->abound[k] = numa ? (sb->arena ? (size_t) ((double) budget * numa->first[k] / numa->first[numa->nnodes]) : (size_t) numa->first[k]) : 0;
+
+  if(numa && sb->arena)
+  {
+    #pragma omp parallel num_threads(numa->first[numa->nnodes])
+    {
+      int t = omp_get_thread_num();
+      int T = omp_get_num_threads();
+
+      numa_Pin(numa);
+      memset(sb->arena + (size_t) ((double) budget * t / T), 0, (size_t) ((double) budget * (t + 1) / T) - (size_t) ((double) budget * t / T));
+    }
+  }
+  return sb;
+
+ERROR:
+  p7_Fail("Failed to allocate a sequence buffer of %d sequences, %zu bytes\n", size, budget);
+  return NULL;
+}
+
+//a buffer that will never be loaded again gives back what it doesn't use: the end of its arena (unless --numa
+//placed its pages) and the records past count
+static void seq_buffer_Shrink(SEQ_BUFFER *sb)
+{
+  int n = ESL_MAX(sb->count, 1);
+
+  if(sb->arena && sb->abound[sb->nslices] == 0 && sb->aused < sb->asize)
+  {
+    sb->asize = ESL_MAX(sb->aused, 1);
+    if ((sb->arena = realloc(sb->arena, sb->asize)) == NULL) goto ERROR;
+    sb->res = (ESL_DSQ *) sb->arena;
+    sb->str = sb->arena;
+  }
+  if ((sb->rec     = realloc(sb->rec, sizeof(HPC_SEQDB_ENTRY) * n)) == NULL) goto ERROR;
+  if ((sb->res_sum = realloc(sb->res_sum, sizeof(int64_t) * (n + 1))) == NULL) goto ERROR;
+  sb->size = n;
+  return;
+
+ERROR:
+  p7_Fail("Failed to shrink a sequence buffer\n");
+}
+
+static void seq_buffer_Destroy(SEQ_BUFFER *sb)
+{
+  if(sb == NULL) return;
+  free(sb->arena);
+  free(sb->rec);
+  free(sb->res_sum);
+  free(sb->slice);
+  free(sb->abound);
+  free(sb);
+}
+
+//--bench_load: time one full pass over the target database with each loader that can read it.
+//the parallel loader gets <threads> threads, the same as a search would give it
+static void benchmark_loaders(char *dbfile, int dbfmt, ESL_ALPHABET *abc, int seq_per_buffer, size_t budget, int threads, FILE *ofp)
+{
+  char       *name[3] = { "easel serial", "parallel FASTA", "mapped hpcdb" };
+  struct stat st;
+  int         r;
+
+  if (fprintf(ofp, "# %-16s %12s %15s %10s %12s %10s\n", "loader", "sequences", "residues", "seconds", "Mresidues/s", "MB/s") < 0) goto ERROR;
+
+  for(r = 0; r < 3; r++)
+  {
+    SEQ_SOURCE  src;
+    SEQ_BUFFER *sb;
+    uint64_t    nseq = 0, nres = 0;
+    double      t0, t1;
+    int         sstatus;
+
+    src.dbfp    = NULL;
+    src.map     = NULL;
+    src.fa      = NULL;
+    src.shard   = 0;
+    src.nshards = 1;
+    src.nread   = 0;
+    src.firstkey = NULL;
+    src.limit    = -1;
+    src.taken    = 0;
+    src.sq       = NULL;
+    src.held     = FALSE;
+    if      (r == 0 && esl_sqfile_Open(dbfile, dbfmt, p7_SEQDBENV, &src.dbfp) == eslOK) esl_sqfile_SetDigital(src.dbfp, abc);
+    else if (r == 1 && fasta_Open(dbfile, &src.fa)                           == eslOK) src.fa->abc = abc;
+    else if (r == 2 && seqdb_Open(dbfile, &src.map)                          == eslOK) ;
+    else continue;
+    sb = seq_buffer_Create(&src, seq_per_buffer, budget, FALSE, abc, NULL);
+
+    t0 = omp_get_wtime();
+    #pragma omp parallel num_threads(threads)
+    {
+      #pragma omp single
+      {
+        do
+        {
+          sstatus = load_seq_buffer(&src, sb);
+          nseq   += sb->count;
+          nres   += sb->res_sum[sb->count];
+        } while(sstatus == eslOK);
+      }
+    }
+    t1 = omp_get_wtime();
+
+    if (fprintf(ofp, "  %-16s %12llu %15llu %10.3f %12.2f %10.2f\n", name[r], (unsigned long long) nseq, (unsigned long long) nres,
+                t1 - t0, (double) nres / (t1 - t0) / 1e6, (stat(dbfile, &st) == 0 ? (double) st.st_size / (t1 - t0) / 1e6 : 0.)) < 0) goto ERROR;
+
+    seq_buffer_Destroy(sb);
+    esl_sq_Destroy(src.sq);
+    if (src.dbfp) esl_sqfile_Close(src.dbfp);
+    if (src.fa)   fasta_Close(src.fa);
+    if (src.map)  seqdb_Close(src.map);
+  }
+  return;
+
+ERROR:
+  p7_Fail("loader benchmark failed\n");
+}
+
+//load from a hmm file into the given hmm buffer
+//return eslOK if the hmm buffer was filled completely. 
+//partial buffers are padded with NULL oprofiles
+//or whatever state they are in after being Reused()
+//return eslEOF if the buffer was partially filled with new data
+//
+//a pressed database (hmmpress .h3m/.h3f/.h3p) is read straight into optimized profiles.
+//otherwise the models are read serially and then configured/converted by one task each,
+//so the whole team helps build a buffer instead of one thread
+static int load_hmm_buffer(P7_HMMFILE *hfp, HMM_BUFFER **hb, int *nquery, int buffer_size, ESL_ALPHABET *abc, ESL_GETOPTS *go)
+{
+  int x;
+  int hstatus = eslOK;
+
+  P7_HMM *hmm = NULL;
+  P7_HMM **hmms = NULL;
+  int status;
+
+  if(! hfp->is_pressed) ESL_ALLOC(hmms, sizeof(P7_HMM *) * buffer_size);
+  
+  for(x = 0; x < buffer_size; x++)
+  {
+    P7_OPROFILE *om = NULL;
+
+    if(hfp->is_pressed)
+    {
+      hstatus = p7_oprofile_ReadMSV(hfp, &abc, &om);
+      if(hstatus == eslOK) hstatus = p7_oprofile_ReadRest(hfp, om);
+    }
+    else
+      hstatus = p7_hmmfile_Read(hfp, &abc, &hmm);
+
+    switch (hstatus)
+    {
+      case eslEOD      : p7_Fail("read failed, HMM file may be truncated?"); break;
+      case eslEFORMAT  : p7_Fail("bad file format in HMM file "           ); break;
+      case eslEINCOMPAT: p7_Fail("HMM file contains different alphabets"  ); break;
+      case eslEOF      :                                                     break;
+      case eslOK       :       
+        *nquery++;
+        if(hfp->is_pressed) hb[x]->om = om;
+        else                hmms[x]   = hmm;
+        break;
+      default:
+        p7_Fail("Unexpected error (%d) in reading HMMs", hstatus);
+    }
+    if(hstatus == eslEOF) break;
+  }
+
+  //x is now the number of models read
+  int nread = x;
+  for(x = 0; x < nread; x++)
+  {
+    #pragma omp task firstprivate(x)
+    {
+      if(! hfp->is_pressed)
+      {
+        P7_PROFILE *gm = p7_profile_Create(hmms[x]->M, abc);
+        hb[x]->om = p7_oprofile_Create(hmms[x]->M, abc);
+        hb[x]->bg = p7_bg_Create(abc);
+        p7_ProfileConfig(hmms[x], hb[x]->bg, gm, 10, p7_LOCAL);
+        p7_oprofile_Convert(gm, hb[x]->om);
+        p7_hmm_Destroy(hmms[x]);
+        p7_profile_Destroy(gm);
+      }
+      else
+        hb[x]->bg = p7_bg_Create(abc);
+
+      //this pipeline never actually gets used, it's just merged statistics counts from
+      //all the worker copies. it needs no dp working memory
+      hb[x]->pli = p7_pipeline_Create(go, 1, 1, FALSE, p7_SEARCH_SEQS);
+
+      hb[x]->th = p7_tophits_Create();
+      p7_pli_NewModel(hb[x]->pli, hb[x]->om, hb[x]->bg);
+      if(hb[x]->topk)
+      {
+        hb[x]->topk->n     = 0;
+        hb[x]->topk->bound = -eslINFINITY;
+      }
+    }
+  }
+  #pragma omp taskwait
+
+  free(hmms);
+  return hstatus;
+
+ERROR:
+  p7_Fail("Failed to allocate hmm buffer\n");
+  return status;
+}
+
+static TOPK *topk_Create(int k)
+{
+  TOPK *tk = NULL;
+
+  if ((tk       = malloc(sizeof(TOPK))) == NULL) goto ERROR;
+  if ((tk->heap = malloc(sizeof(double) * k)) == NULL) goto ERROR;
+  omp_init_lock(&tk->lock);
+  tk->k     = k;
+  tk->n     = 0;
+  tk->bound = -eslINFINITY;
+  return tk;
+
+ERROR:
+  p7_Fail("Failed to allocate --top_k scores\n");
+  return NULL;
+}
+
+static void topk_Destroy(TOPK *tk)
+{
+  if (tk == NULL) return;
+  omp_destroy_lock(&tk->lock);
+  free(tk->heap);
+  free(tk);
+}
+
+//a new hit of the model, by its sort key. FALSE when k hits already rank strictly above it.
+//keys that can't enter the heap skip the lock
+static int topk_Add(TOPK *tk, double sc)
+{
+  double bound;
+  int    i, c;
+
+  #pragma omp atomic read
+  bound = tk->bound;
+  if (sc <  bound) return FALSE;
+  if (sc == bound) return TRUE;
+
+  omp_set_lock(&tk->lock);
+  if (tk->n < tk->k)
+  {
+    for (i = tk->n++; i > 0 && tk->heap[(i - 1) / 2] > sc; i = (i - 1) / 2) tk->heap[i] = tk->heap[(i - 1) / 2];
+    tk->heap[i] = sc;
+  }
+  else if (sc > tk->heap[0])
+  {
+    for (i = 0; (c = 2 * i + 1) < tk->n; i = c)
+    {
+      if (c + 1 < tk->n && tk->heap[c + 1] < tk->heap[c]) c++;
+      if (tk->heap[c] >= sc) break;
+      tk->heap[i] = tk->heap[c];
+    }
+    tk->heap[i] = sc;
+  }
+  if (tk->n == tk->k)
+  {
+    #pragma omp atomic write
+    tk->bound = tk->heap[0];
+  }
+  omp_unset_lock(&tk->lock);
+  return TRUE;
+}
+
+//--top_k: keep the first k reported targets of a sorted, thresholded list; the rest, and their domains,
+//are no longer reported or included
+static void topk_Truncate(P7_TOPHITS *th, int k)
+{
+  uint64_t h;
+  int      d, n = 0;
+
+  for (h = 0; h < th->N; h++)
+  {
+    P7_HIT *hit = th->hit[h];
+
+    if (! (hit->flags & p7_IS_REPORTED) || ++n <= k) continue;
+    if (hit->flags & p7_IS_INCLUDED) th->nincluded--;
+    th->nreported--;
+    hit->flags &= ~(p7_IS_REPORTED | p7_IS_INCLUDED);
+    for (d = 0; d < hit->ndom; d++) hit->dcl[d].is_reported = hit->dcl[d].is_included = FALSE;
+    hit->nreported = hit->nincluded = 0;
+  }
+}
+
+//--noali without -A: cut each domain's alignment display down, in place, to an empty one that keeps the
+//coordinates and lengths the domain tables and the --noali main output print. it is still a well formed display
+//(of length zero, in one block), so merging, sorting and MPI packing handle it like any other. a display made in
+//one block, as p7_Pipeline makes them, is shrunk with a realloc, so this adds no allocation
+static void hit_StripAlignments(P7_HIT *hit)
+{
+  P7_ALIDISPLAY *ad;
+  char          *mem;
+  int            d;
+
+  for (d = 0; d < hit->ndom; d++)
+  {
+    if ((ad = hit->dcl[d].ad) == NULL) continue;
+
+    if (ad->mem) mem = realloc(ad->mem, 1);
+    else
+    {
+      free(ad->rfline); free(ad->mmline); free(ad->csline); free(ad->model);   free(ad->mline);
+      free(ad->aseq);   free(ad->ntseq);  free(ad->ppline); free(ad->hmmname); free(ad->hmmacc);
+      free(ad->hmmdesc); free(ad->sqname); free(ad->sqacc); free(ad->sqdesc);
+      mem = malloc(1);
+    }
+    if (mem == NULL) p7_Fail("Failed to allocate an alignment display\n");
+
+    mem[0]      = '\0';
+    ad->mem     = mem;
+    ad->memsize = 1;
+    ad->N       = 0;
+    ad->rfline  = ad->rfline  ? mem : NULL;
+    ad->mmline  = ad->mmline  ? mem : NULL;
+    ad->csline  = ad->csline  ? mem : NULL;
+    ad->model   = mem;
+    ad->mline   = mem;
+    ad->aseq    = mem;
+    ad->ntseq   = ad->ntseq   ? mem : NULL;
+    ad->ppline  = ad->ppline  ? mem : NULL;
+    ad->hmmname = mem;
+    ad->hmmacc  = ad->hmmacc  ? mem : NULL;
+    ad->hmmdesc = ad->hmmdesc ? mem : NULL;
+    ad->sqname  = mem;
+    ad->sqacc   = ad->sqacc   ? mem : NULL;
+    ad->sqdesc  = ad->sqdesc  ? mem : NULL;
+  }
+}
+
+//--top_k: a hit that can't be in the output keeps its score, P-value and sort key, which are all that
+//thresholding and the domZ count read, and frees its domains
+static void hit_DropDomains(P7_HIT *hit)
+{
+  int d;
+
+  for (d = 0; d < hit->ndom; d++)
+  {
+    p7_alidisplay_Destroy(hit->dcl[d].ad);
+    free(hit->dcl[d].scores_per_pos);
+  }
+  free(hit->dcl);
+  hit->dcl         = NULL;
+  hit->ndom        = 0;
+  hit->best_domain = 0;
+}
+
+//add a finished work unit's pipeline counters to an accumulator
+static void counts_Add(PLI_COUNTS *c, const P7_PIPELINE *pli)
+{
+  c->nseqs         += pli->nseqs;
+  c->nres          += pli->nres;
+  c->n_past_msv    += pli->n_past_msv;
+  c->n_past_bias   += pli->n_past_bias;
+  c->n_past_vit    += pli->n_past_vit;
+  c->n_past_fwd    += pli->n_past_fwd;
+  c->n_output      += pli->n_output;
+  c->pos_past_msv  += pli->pos_past_msv;
+  c->pos_past_bias += pli->pos_past_bias;
+  c->pos_past_vit  += pli->pos_past_vit;
+  c->pos_past_fwd  += pli->pos_past_fwd;
+  c->pos_output    += pli->pos_output;
+}
+
+//a += b, then clear b
+static void counts_Sum(PLI_COUNTS *a, PLI_COUNTS *b)
+{
+  a->nseqs         += b->nseqs;
+  a->nres          += b->nres;
+  a->n_past_msv    += b->n_past_msv;
+  a->n_past_bias   += b->n_past_bias;
+  a->n_past_vit    += b->n_past_vit;
+  a->n_past_fwd    += b->n_past_fwd;
+  a->n_output      += b->n_output;
+  a->pos_past_msv  += b->pos_past_msv;
+  a->pos_past_bias += b->pos_past_bias;
+  a->pos_past_vit  += b->pos_past_vit;
+  a->pos_past_fwd  += b->pos_past_fwd;
+  a->pos_output    += b->pos_output;
+  memset(b, 0, sizeof(PLI_COUNTS));
+}
+
+//what p7_pipeline_Merge does with a sequence search pipeline, from the summed counters
+static void counts_Merge(P7_PIPELINE *pli, PLI_COUNTS *c)
+{
+  pli->nseqs         += c->nseqs;
+  pli->nres          += c->nres;
+  pli->n_past_msv    += c->n_past_msv;
+  pli->n_past_bias   += c->n_past_bias;
+  pli->n_past_vit    += c->n_past_vit;
+  pli->n_past_fwd    += c->n_past_fwd;
+  pli->n_output      += c->n_output;
+  pli->pos_past_msv  += c->pos_past_msv;
+  pli->pos_past_bias += c->pos_past_bias;
+  pli->pos_past_vit  += c->pos_past_vit;
+  pli->pos_past_fwd  += c->pos_past_fwd;
+  pli->pos_output    += c->pos_output;
+  if (pli->Z_setby == p7_ZSETBY_NTARGETS) pli->Z += c->nseqs;
+  memset(c, 0, sizeof(PLI_COUNTS));
+}
+
+//fold a finished work unit into thread t's accumulators for the model. only thread t ever touches
+//slot t, and a child task run at a spawn point finishes before its parent gets here, so no lock is needed
+static void hit_accumulate(HMM_BUFFER *hb, int t, P7_TOPHITS *th, P7_PIPELINE *pli)
+{
+  if (th->N > 0)
+  {
+    if (hb->th_part[t] == NULL) hb->th_part[t] = p7_tophits_Create();
+    p7_tophits_Merge(hb->th_part[t], th);
+  }
+  counts_Add(&hb->cnt_part[t], pli);
+}
+
+//combine the per-thread accumulators of one model into hb->th and hb->pli, pairwise in log2(threads)
+//rounds of parallel merges. merged lists come out sorted by sortkey and the counters are sums, so the
+//order in which work units finished makes no difference to what gets reported
+static void hit_reduce(HMM_BUFFER *hb, int nthreads)
+{
+  int s, t;
+
+  for (s = 1; s < nthreads; s *= 2)
+  {
+    for (t = 0; t + s < nthreads; t += 2 * s)
+    {
+      #pragma omp task firstprivate(s, t)
+      {
+        if (hb->th_part[t + s] != NULL)
+        {
+          if (hb->th_part[t] == NULL) hb->th_part[t] = hb->th_part[t + s];
+          else
+          {
+            p7_tophits_Merge(hb->th_part[t], hb->th_part[t + s]);
+            p7_tophits_Destroy(hb->th_part[t + s]);
+          }
+          hb->th_part[t + s] = NULL;
+        }
+        counts_Sum(&hb->cnt_part[t], &hb->cnt_part[t + s]);
+      }
+    }
+    #pragma omp taskwait
+  }
+
+  if (hb->th_part[0] != NULL)
+  {
+    p7_tophits_Merge(hb->th, hb->th_part[0]);
+    p7_tophits_Destroy(hb->th_part[0]);
+    hb->th_part[0] = NULL;
+  }
+  counts_Merge(hb->pli, &hb->cnt_part[0]);
+}
+
+//one model's formatted output, held in memory until its turn to be written
+typedef struct
+{
+  char   *buf[OUT_NSTREAMS];
+  size_t  len[OUT_NSTREAMS];
+} MODEL_OUTPUT;
+
+//a model's results have been written (or sent to rank 0); free it and mark its slot empty
+static void model_Release(HMM_BUFFER *hb)
+{
+  int k;
+
+  for(k = 0; k < hb->nnodes; k++) { p7_oprofile_Destroy(hb->om_node[k]); hb->om_node[k] = NULL; }
+  hb->trace_name = -1;
+  p7_pipeline_Destroy(hb->pli);
+  p7_tophits_Destroy (hb->th );
+  p7_oprofile_Destroy(hb->om );
+  p7_bg_Destroy      (hb->bg );
+
+  hb->om = NULL;
+}
+
+//everything output_hmm_buffer used to print for one model, now into memory streams, then the model is freed.
+//the code is the serial path with the FILE pointers swapped, so the bytes are the same
+static void format_model(HMM_BUFFER *hb, int nquery, OUTPUT_INFO *oi, MODEL_OUTPUT *mo)
+{
+  FILE *fp[OUT_NSTREAMS] = { NULL, NULL, NULL, NULL, NULL };
+  int   want[OUT_NSTREAMS];
+  int   s;
+
+  want[OUT_MAIN]    = TRUE;
+  want[OUT_TBL]     = (oi->tblfp     != NULL);
+  want[OUT_DOMTBL]  = (oi->domtblfp  != NULL);
+  want[OUT_PFAMTBL] = (oi->pfamtblfp != NULL);
+  want[OUT_ALI]     = (oi->afp       != NULL);
+  for(s = 0; s < OUT_NSTREAMS; s++)
+  {
+    mo->buf[s] = NULL;
+    mo->len[s] = 0;
+    if(want[s] && (fp[s] = open_memstream(&mo->buf[s], &mo->len[s])) == NULL) p7_Fail("Failed to open an output buffer\n");
+  }
+
+  FILE       *ofp = fp[OUT_MAIN];
+  FILE       *afp = fp[OUT_ALI];
+  FILE     *tblfp = fp[OUT_TBL];
+  FILE  *domtblfp = fp[OUT_DOMTBL];
+  FILE *pfamtblfp = fp[OUT_PFAMTBL];
+
+  ESL_ALPHABET *abc = oi->abc;
+  ESL_GETOPTS   *go = oi->go;
+
+  if (fprintf(ofp, "Query:       %s  [M=%d]\n", hb->om->name, hb->om->M)  < 0) { fprintf(stderr, "output write failed\n"); exit(0); }
+  if (hb->om->acc) { if (fprintf(ofp, "Accession:   %s\n", hb->om->acc)   < 0) { fprintf(stderr, "output write failed\n"); exit(0); } } 
+  if (hb->om->desc) { if (fprintf(ofp, "Description: %s\n", hb->om->desc) < 0) { fprintf(stderr, "output write failed\n"); exit(0); } }
+
+  p7_tophits_SortBySortkey(hb->th);
+  p7_tophits_Threshold(hb->th, hb->pli);
+  if (hb->topk) topk_Truncate(hb->th, hb->topk->k);
+  p7_tophits_Targets(ofp, hb->th, hb->pli, oi->textw);
+  if (fprintf(ofp, "\n\n") < 0) { fprintf(stderr, "output write failed\n"); exit(0); }
+
+  p7_tophits_Domains(ofp, hb->th, hb->pli, oi->textw);
+  if (fprintf(ofp, "\n\n") < 0) { fprintf(stderr, "output write failed\n"); exit(0); }
+
+  if (tblfp)     p7_tophits_TabularTargets (    tblfp, hb->om->name, hb->om->acc, hb->th, hb->pli, (nquery == 1));
+  if (domtblfp)  p7_tophits_TabularDomains ( domtblfp, hb->om->name, hb->om->acc, hb->th, hb->pli, (nquery == 1));
+  if (pfamtblfp) p7_tophits_TabularXfam    (pfamtblfp, hb->om->name, hb->om->acc, hb->th, hb->pli               );
+
+  p7_pli_Statistics(ofp, hb->pli, NULL);
+  if (fprintf(ofp, "//\n") < 0) { fprintf(stderr, "output write failed\n"); exit(0); }
+
+  /* Output the results in an MSA (-A option) */
+  if (afp)
+  {
+    ESL_MSA *msa = NULL;
+
+    if (p7_tophits_Alignment(hb->th, abc, NULL, NULL, 0, p7_ALL_CONSENSUS_COLS, &msa) == eslOK)
+    {
+      if (oi->textw > 0) esl_msafile_Write(afp, msa, eslMSAFILE_STOCKHOLM);
+      else               esl_msafile_Write(afp, msa, eslMSAFILE_PFAM);
+      if (fprintf(ofp, "# Alignment of %d hits satisfying inclusion thresholds saved to: %s\n", msa->nseq, esl_opt_GetString(go, "-A")) < 0)
+        { fprintf(stderr, "output write failed\n"); exit(0); }
+    }
+    else
+      if (fprintf(ofp, "# No hits satisfy inclusion thresholds; no alignment saved\n") < 0) { fprintf(stderr, "output write failed\n"); exit(1); }
+
+    esl_msa_Destroy(msa);
+  }
+
+  for(s = 0; s < OUT_NSTREAMS; s++)
+    if(fp[s] && fclose(fp[s]) != 0) { fprintf(stderr, "output write failed\n"); exit(0); }
+
+  model_Release(hb);
+}
+
+//the real output files, indexed like MODEL_OUTPUT; NULL where an output is off
+static void output_files(OUTPUT_INFO *oi, FILE **fp)
+{
+  fp[OUT_MAIN]    = oi->ofp;
+  fp[OUT_TBL]     = oi->tblfp;
+  fp[OUT_DOMTBL]  = oi->domtblfp;
+  fp[OUT_PFAMTBL] = oi->pfamtblfp;
+  fp[OUT_ALI]     = oi->afp;
+}
+
+//append one model's formatted output to the real files, one write per stream
+static void write_model(OUTPUT_INFO *oi, MODEL_OUTPUT *mo)
+{
+  FILE *fp[OUT_NSTREAMS];
+  int   s;
+
+  output_files(oi, fp);
+
+  for(s = 0; s < OUT_NSTREAMS; s++)
+  {
+    if(mo->buf[s] == NULL) continue;
+    if(mo->len[s] > 0 && fwrite(mo->buf[s], 1, mo->len[s], fp[s]) != mo->len[s]) { fprintf(stderr, "output write failed\n"); exit(0); }
+    free(mo->buf[s]);
+    mo->buf[s] = NULL;
+  }
+}
+
+//FNV-1a, with the terminating NUL so that "ab" "c" and "a" "bc" differ
+static uint64_t hash_string(uint64_t h, const char *p)
+{
+  do { h = (h ^ (unsigned char) *p) * 1099511628211ULL; } while(*p++);
+  return h;
+}
+
+//a hash of the arguments a restart has to repeat: the two files and every option that changes the
+//output. thread and buffer options (docgroup 13) may differ, so a resumed job can land on another machine
+static uint64_t checkpoint_Hash(ESL_GETOPTS *go)
+{
+  uint64_t h = 14695981039346656037ULL;
+  int      i;
+
+  h = hash_string(h, esl_opt_GetArg(go, 1));
+  h = hash_string(h, esl_opt_GetArg(go, 2));
+  for(i = 0; options[i].name != NULL; i++)
+  {
+    if(options[i].docgrouptag == 13 || ! esl_opt_IsUsed(go, options[i].name)) continue;
+    h = hash_string(h, options[i].name);
+    h = hash_string(h, go->val[i] ? go->val[i] : "");
+  }
+  return h;
+}
+
+//look for the checkpoint of an interrupted run. no file means a fresh start;
+//a checkpoint left by different arguments is refused rather than silently overwritten
+static void checkpoint_Read(CHECKPOINT *ck)
+{
+  FILE              *fp;
+  int                version;
+  unsigned long long args;
+  long long          nmodels;
+  long long          off[OUT_NSTREAMS];
+  int                s;
+
+  ck->resume = FALSE;
+  if((fp = fopen(ck->file, "r")) == NULL) return;
+
+  if(fscanf(fp, "hpc_hmmsearch checkpoint %d\n", &version) != 1 || version != 1 ||
+     fscanf(fp, "args %llx\n",   &args)                     != 1 ||
+     fscanf(fp, "models %lld\n", &nmodels)                  != 1 ||
+     fscanf(fp, "nquery %d\n",   &ck->nquery)               != 1 ||
+     fscanf(fp, "offsets %lld %lld %lld %lld %lld\n", &off[0], &off[1], &off[2], &off[3], &off[4]) != OUT_NSTREAMS)
+    p7_Fail("Checkpoint file %s is damaged; remove it to start over\n", ck->file);
+  fclose(fp);
+
+  if(args != ck->args)
+    p7_Fail("Checkpoint file %s was written by a run with different arguments; remove it to start over\n", ck->file);
+
+  ck->resume  = TRUE;
+  ck->nmodels = nmodels;
+  for(s = 0; s < OUT_NSTREAMS; s++) ck->off[s] = off[s];
+}
+
+//open an output file for writing. when resuming, the file is kept and cut back to where the
+//checkpoint says the finished models' output ends, dropping whatever the killed run wrote after it
+static FILE *checkpoint_Open(CHECKPOINT *ck, int which, const char *filename)
+{
+  struct stat st;
+  FILE       *fp;
+
+  if(ck == NULL || ! ck->resume) return fopen(filename, "w");
+
+  if((fp = fopen(filename, "r+")) == NULL) p7_Fail("Can't resume from checkpoint %s: output file %s is missing\n", ck->file, filename);
+  if(fstat(fileno(fp), &st) != 0 || st.st_size < ck->off[which])
+    p7_Fail("Can't resume from checkpoint %s: output file %s is shorter than the checkpoint says\n", ck->file, filename);
+  if(ftruncate(fileno(fp), ck->off[which]) != 0 || fseeko(fp, ck->off[which], SEEK_SET) != 0)
+    p7_Fail("Can't resume from checkpoint %s: failed to truncate %s\n", ck->file, filename);
+  return fp;
+}
+
+//after an hmm buffer's output is written: get it onto the disk, then record that it is there.
+//the record is written to a temporary file and renamed over the old one, so a kill at any point
+//leaves either the previous checkpoint or this one
+static void checkpoint_Write(OUTPUT_INFO *oi, int nmodels, int nquery)
+{
+  CHECKPOINT *ck = oi->ckpt;
+  FILE       *fp[OUT_NSTREAMS];
+  FILE       *cfp;
+  char       *tmp = NULL;
+  int         s;
+
+  output_files(oi, fp);
+  for(s = 0; s < OUT_NSTREAMS; s++)
+  {
+    ck->off[s] = 0;
+    if(fp[s] == NULL) continue;
+    if(fflush(fp[s]) != 0 || fsync(fileno(fp[s])) != 0) p7_Fail("Failed to sync output for checkpoint\n");
+    ck->off[s] = ftello(fp[s]);
+  }
+  ck->nmodels += nmodels;
+  ck->nquery   = nquery;
+
+  if(esl_sprintf(&tmp, "%s.tmp", ck->file) != eslOK) p7_Fail("allocation failed\n");
+  if((cfp = fopen(tmp, "w")) == NULL) p7_Fail("Failed to open checkpoint file %s for writing\n", tmp);
+  if(fprintf(cfp, "hpc_hmmsearch checkpoint 1\nargs %llx\nmodels %lld\nnquery %d\noffsets %lld %lld %lld %lld %lld\n",
+             (unsigned long long) ck->args, (long long) ck->nmodels, ck->nquery,
+             (long long) ck->off[0], (long long) ck->off[1], (long long) ck->off[2], (long long) ck->off[3], (long long) ck->off[4]) < 0 ||
+     fflush(cfp) != 0 || fsync(fileno(cfp)) != 0 || fclose(cfp) != 0 || rename(tmp, ck->file) != 0)
+    p7_Fail("Failed to write checkpoint file %s\n", ck->file);
+  free(tmp);
+}
+
+//read past the models a checkpoint says are finished, so load_hmm_buffer starts at the first unfinished one
+static void skip_hmm_models(P7_HMMFILE *hfp, int64_t n, ESL_ALPHABET *abc)
+{
+  P7_OPROFILE *om  = NULL;
+  P7_HMM      *hmm = NULL;
+  int64_t      x;
+  int          hstatus = eslOK;
+
+  for(x = 0; x < n; x++)
+  {
+    if(hfp->is_pressed)
+    {
+      if((hstatus = p7_oprofile_ReadMSV(hfp, &abc, &om)) == eslOK) hstatus = p7_oprofile_ReadRest(hfp, om);
+      p7_oprofile_Destroy(om);
+      om = NULL;
+    }
+    else
+    {
+      hstatus = p7_hmmfile_Read(hfp, &abc, &hmm);
+      p7_hmm_Destroy(hmm);
+      hmm = NULL;
+    }
+    if(hstatus != eslOK) p7_Fail("Checkpoint says %lld models are done, but the HMM file ended at %lld\n", (long long) n, (long long) x);
+  }
+}
+
+#ifdef HAVE_MPI
+#define HPC_MPI_TOPHITS_TAG  1
+#define HPC_MPI_PIPELINE_TAG 2
+
+//bring the results of every rank for a reduced hmm buffer to rank 0, model by model in buffer order.
+//rank 0 merges them into its own th and pli, which then hold the whole database. p7_pipeline_Merge
+//adds the ranks' target counts into Z, so E-values come out as in a single process search
+//
+//only the thread running output_hmm_buffer talks MPI, and output_hmm_buffer calls don't overlap
+static void mpi_gather_hmm_buffer(HMM_BUFFER **hb, int n, OUTPUT_INFO *oi)
+{
+  P7_TOPHITS  *th  = NULL;
+  P7_PIPELINE *pli = NULL;
+  int          x, r;
+
+  for(x = 0; x < n; x++)
+  {
+    if(oi->rank != 0)
+    {
+      if(p7_tophits_MPISend (hb[x]->th,  0, HPC_MPI_TOPHITS_TAG,  MPI_COMM_WORLD, &oi->mpi_buf, &oi->mpi_nalloc) != eslOK ||
+         p7_pipeline_MPISend(hb[x]->pli, 0, HPC_MPI_PIPELINE_TAG, MPI_COMM_WORLD, &oi->mpi_buf, &oi->mpi_nalloc) != eslOK)
+        p7_Fail("rank %d failed to send the results for %s\n", oi->rank, hb[x]->om->name);
+      continue;
+    }
+
+    for(r = 1; r < oi->nranks; r++)
+    {
+      if(p7_tophits_MPIRecv (r, HPC_MPI_TOPHITS_TAG,  MPI_COMM_WORLD, &oi->mpi_buf, &oi->mpi_nalloc,         &th)  != eslOK ||
+         p7_pipeline_MPIRecv(r, HPC_MPI_PIPELINE_TAG, MPI_COMM_WORLD, &oi->mpi_buf, &oi->mpi_nalloc, oi->go, &pli) != eslOK)
+        p7_Fail("failed to receive the results of rank %d for %s\n", r, hb[x]->om->name);
+
+      p7_tophits_Merge  (hb[x]->th,  th);
+      p7_pipeline_Merge (hb[x]->pli, pli);
+      p7_tophits_Destroy(th);
+      p7_pipeline_Destroy(pli);
+    }
+  }
+}
+#endif /*HAVE_MPI*/
+
+//go into the hmm buffer and output its contents
+//stop outputting when null model data is found (meaning it's a partial or empty block)
+//
+//each model is reduced and formatted into memory by its own task. writer tasks, chained through
+//an inout dependence on oi, then append the buffers to the output files strictly in query order while
+//later models are still being formatted
+static int output_hmm_buffer(HMM_BUFFER **hb, int buffer_size, int nquery, OUTPUT_INFO *oi)
+{
+  MODEL_OUTPUT *mo = NULL;
+  int           reduced = FALSE;
+  int           n, x;
+  int           status;
+
+  for(n = 0; n < buffer_size && hb[n]->om != NULL; n++) ;
+  if(n == 0) return eslOK;
+
+#ifdef HAVE_MPI
+  //with several ranks every model has to be complete on this rank before it is sent
+  if(oi->nranks > 1)
+  {
+    for(x = 0; x < n; x++)
+    {
+      #pragma omp task firstprivate(x)
+      {
+        double t[2];
+        stats_Start(oi->stats, t);
+        hit_reduce(hb[x], oi->threads);
+        stats_Stop(oi->stats, ST_MERGE, t);
+      }
+    }
+    #pragma omp taskwait
+    reduced = TRUE;
+
+    mpi_gather_hmm_buffer(hb, n, oi);
+    if(oi->rank != 0)
+    {
+      for(x = 0; x < n; x++) model_Release(hb[x]);
+      return eslOK;
+    }
+  }
+#endif
+
+  ESL_ALLOC(mo, sizeof(MODEL_OUTPUT) * n);
+
+  for(x = 0; x < n; x++)
+  {
+    #pragma omp task firstprivate(x) depend(out: mo[x])
+    {
+      double t[2];
+
+      //first gather the results the threads left for this model
+      stats_Start(oi->stats, t);
+      if(!reduced) hit_reduce(hb[x], oi->threads);
+      stats_Stop(oi->stats, ST_MERGE, t);
+
+      stats_Model(oi->stats, hb[x]);
+      format_model(hb[x], nquery, oi, &mo[x]);
+      stats_Stop(oi->stats, ST_FORMAT, t);
+    }
+
+    #pragma omp task firstprivate(x) depend(in: mo[x]) depend(inout: oi[0])
+    {
+      double t[2];
+      stats_Start(oi->stats, t);
+      write_model(oi, &mo[x]);
+      stats_Stop(oi->stats, ST_FORMAT, t);
+    }
+  }
+  #pragma omp taskwait
+
+  if(oi->ckpt) checkpoint_Write(oi, n, nquery);
+
+  free(mo);
+  return eslOK;
+
+ERROR:
+  p7_Fail("Failed to allocate output buffers\n");
+  return status;
+}
+
+#ifdef HAVE_MSV_BATCH
+//Batched MSV filter. The pipeline runs the striped MSV filter one sequence at a time, which vectorizes across
+//model positions and leaves most of a vector idle on short targets. Here the byte lanes hold different target
+//sequences instead, all scored against the same profile, and a lane that finishes is refilled with the next
+//sequence of the window. Every lane does exactly the byte arithmetic of p7_MSVFilter (same saturation, same
+//overflow test, its own length dependent tjb), so its score and its pass/fail against F1 are identical.
+//Sequences that pass still go through p7_Pipeline, which repeats MSV and carries on as before.
+//
+//The row loop exists once per instruction set (16, 32 or 64 lanes); simd_level picks one at startup.
+
+#define MSV_MAXLANES 64
+#define MSV_WINDOW   1024    //sequences decided per call; kept small so a work unit split doesn't waste much
+#define MSV_MAXLEN   100000  //p7_Pipeline rejects longer targets, so leave them to it
+
+typedef struct
+{
+  int            M;
+  int            allocM;
+  int            W;                    //lanes: 16 for SSE, 32 for AVX2, 64 for AVX-512
+  int            level;
+  __m128i       *tab;                  //2 vectors per model position k: match scores for residue codes 0-15, then 16-31
+  uint8_t       *dp;                   //W bytes per model position: lane j's MSV match state k at the current row
+  void          *mem;
+  uint8_t        pass[MSV_WINDOW];
+  int            lo, hi;               //sb->rec[lo..hi-1] have a decision in pass[]
+
+  //lane state between calls of the row loop
+  const ESL_DSQ *p[MSV_MAXLANES];      //next residue
+  int            step[MSV_MAXLANES];   //1 while the lane has a sequence, 0 when idle
+  uint8_t        r[MSV_MAXLANES];
+  uint8_t        xB[MSV_MAXLANES];
+  uint8_t        xJ[MSV_MAXLANES];
+  uint8_t        tjbm[MSV_MAXLANES];
+  uint8_t        fresh[MSV_MAXLANES];  //0xff for a lane refilled since the last row loop
+} MSV_BATCH;
+
+//scratch for one thread; msv_batch_Prepare sizes it for a model
+static MSV_BATCH *msv_batch_Create(int level)
+{
+  MSV_BATCH *mb = NULL;
+
+  if (level == SIMD_NONE) return NULL;
+
+  if ((mb = malloc(sizeof(MSV_BATCH))) == NULL) goto ERROR;
+  mb->W      = 16 << (level - SIMD_SSE);
+  mb->level  = level;
+  mb->mem    = NULL;
+  mb->M      = mb->allocM = 0;
+  mb->lo     = mb->hi = 0;
+  return mb;
+
+ERROR:
+  p7_Fail("Failed to allocate the batched MSV filter\n");
+  return NULL;
+}
+
+//transpose the striped byte profile into per-position lookup tables for pshufb.
+//rbv element z of vector q holds position k = z*Q + q + 1. eslEINCOMPAT if the alphabet is too big for the tables
+static int msv_batch_Prepare(MSV_BATCH *mb, const P7_OPROFILE *om)
+{
+  int Q = p7O_NQB(om->M);
+  int k, x;
+  int status;
+
+  if (om->abc->Kp > 32) return eslEINCOMPAT;
+
+  if (om->M > mb->allocM)
+  {
+    ESL_REALLOC(mb->mem, (sizeof(__m128i) * 2 + mb->W) * (om->M + 1) + 127);
+    mb->allocM = om->M;
+  }
+  mb->tab = (__m128i *) (((uintptr_t) mb->mem + 63) & ~((uintptr_t) 63));
+  mb->dp  = (uint8_t *) (((uintptr_t) (mb->tab + 2 * (om->M + 1)) + 63) & ~((uintptr_t) 63));
+  mb->M   = om->M;
+  mb->lo  = mb->hi = 0;
+
+  for (k = 1; k <= om->M; k++)
+  {
+    uint8_t *t = (uint8_t *) (mb->tab + 2 * k);
+    for (x = 0; x < 32; x++)
+      t[x] = (x < om->abc->Kp) ? ((uint8_t *) (om->rbv[x] + (k - 1) % Q))[(k - 1) / Q] : 255;
+  }
+  return eslOK;
+
+ERROR:
+  p7_Fail("Failed to allocate the batched MSV filter\n");
+  return status;
+}
+
+static void msv_batch_Destroy(MSV_BATCH *mb)
+{
+  if (mb == NULL) return;
+  if (mb->mem) free(mb->mem);
+  free(mb);
+}
+
+//tjb_b for target length L, computed by the library on the working copy and put back
+static uint8_t msv_tjb(P7_OPROFILE *om, int L)
+{
+  uint8_t save = om->tjb_b;
+  uint8_t tjb;
+
+  p7_oprofile_ReconfigMSVLength(om, L);
+  tjb       = om->tjb_b;
+  om->tjb_b = save;
+  return tjb;
+}
+
+//the tail of p7_Pipeline's first stage for a lane that finished with xJ
+static int msv_batch_Decide(P7_OPROFILE *om, P7_BG *bg, const ESL_DSQ *dsq, int L, uint8_t xJ, uint8_t tjb, double F1)
+{
+  float  usc, nullsc, seq_score;
+  double P;
+
+  usc  = ((float) (xJ - tjb) - (float) om->base_b);
+  usc /= om->scale_b;
+  usc -= 3.0;
+
+  p7_bg_SetLength(bg, L);
+  p7_bg_NullOne(bg, dsq, L, &nullsc);
+  seq_score = (usc - nullsc) / eslCONST_LOG2;
+  P         = esl_gumbel_surv(seq_score, om->evparam[p7_MMU], om->evparam[p7_MLAMBDA]);
+  return (P > F1) ? FALSE : TRUE;
+}
+
+//The row loops: advance every lane one residue per row until some active lane hits the end of its
+//sequence (row == next) or overflows. Return the overflowed lanes. Residue codes 16-31 get the high bit
+//from +0x70 and read as 0 from the low table; codes 0-15 wrap negative with -0x10 and read as 0 from the high one
+__attribute__((target("ssse3")))
+static uint64_t msv_rows_sse(MSV_BATCH *mb, const P7_OPROFILE *om, int64_t *row, int64_t next, uint64_t activemask, uint64_t freshmask)
+{
+  __m128i  biasv = _mm_set1_epi8((int8_t) om->bias_b);
+  __m128i  tecv  = _mm_set1_epi8((int8_t) om->tec_b);
+  __m128i  basev = _mm_set1_epi8((int8_t) om->base_b);
+  __m128i  ceilv = _mm_set1_epi8((int8_t) 0xff);
+  __m128i  lo_off = _mm_set1_epi8(0x70), hi_off = _mm_set1_epi8(0x10);
+  __m128i  xBv   = _mm_loadu_si128((__m128i *) mb->xB);
+  __m128i  xJv   = _mm_loadu_si128((__m128i *) mb->xJ);
+  __m128i  freshv = _mm_loadu_si128((__m128i *) mb->fresh);
+  __m128i  tjbmv = _mm_loadu_si128((__m128i *) mb->tjbm);
+  __m128i *dp    = (__m128i *) mb->dp;
+  __m128i *tab;
+  __m128i  xEv, mpv, sv, rsc, ilo, ihi;
+  uint64_t ov;
+  int      j, k;
+
+  //a refilled lane starts from an all zero previous row
+  if (freshmask)
+    for (k = 1; k <= om->M; k++) dp[k] = _mm_andnot_si128(freshv, dp[k]);
+
+  do
+  {
+    (*row)++;
+    for (j = 0; j < 16; j++) { mb->r[j] = *mb->p[j]; mb->p[j] += mb->step[j]; }
+    ilo = _mm_add_epi8(_mm_loadu_si128((__m128i *) mb->r), lo_off);
+    ihi = _mm_sub_epi8(_mm_loadu_si128((__m128i *) mb->r), hi_off);
+
+    xEv = _mm_setzero_si128();
+    mpv = _mm_setzero_si128();
+    for (k = 1, tab = mb->tab + 2; k <= om->M; k++, tab += 2)
+    {
+      rsc   = _mm_or_si128(_mm_shuffle_epi8(tab[0], ilo), _mm_shuffle_epi8(tab[1], ihi));
+      sv    = _mm_max_epu8(mpv, xBv);
+      sv    = _mm_adds_epu8(sv, biasv);
+      sv    = _mm_subs_epu8(sv, rsc);
+      xEv   = _mm_max_epu8(xEv, sv);
+      mpv   = dp[k];
+      dp[k] = sv;
+    }
+
+    //the overflow test of p7_MSVFilter; such a target passes with an infinite score
+    ov  = (uint64_t) (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_adds_epu8(xEv, biasv), ceilv)) & activemask;
+
+    xEv = _mm_subs_epu8(xEv, tecv);
+    xJv = _mm_max_epu8(xJv, xEv);
+    xBv = _mm_max_epu8(basev, xJv);
+    xBv = _mm_subs_epu8(xBv, tjbmv);
+  } while (! ov && *row != next);
+
+  _mm_storeu_si128((__m128i *) mb->xB, xBv);
+  _mm_storeu_si128((__m128i *) mb->xJ, xJv);
+  return ov;
+}
+
+__attribute__((target("avx2")))
+static uint64_t msv_rows_avx2(MSV_BATCH *mb, const P7_OPROFILE *om, int64_t *row, int64_t next, uint64_t activemask, uint64_t freshmask)
+{
+  __m256i  biasv = _mm256_set1_epi8((int8_t) om->bias_b);
+  __m256i  tecv  = _mm256_set1_epi8((int8_t) om->tec_b);
+  __m256i  basev = _mm256_set1_epi8((int8_t) om->base_b);
+  __m256i  ceilv = _mm256_set1_epi8((int8_t) 0xff);
+  __m256i  lo_off = _mm256_set1_epi8(0x70), hi_off = _mm256_set1_epi8(0x10);
+  __m256i  xBv   = _mm256_loadu_si256((__m256i *) mb->xB);
+  __m256i  xJv   = _mm256_loadu_si256((__m256i *) mb->xJ);
+  __m256i  freshv = _mm256_loadu_si256((__m256i *) mb->fresh);
+  __m256i  tjbmv = _mm256_loadu_si256((__m256i *) mb->tjbm);
+  __m256i *dp    = (__m256i *) mb->dp;
+  __m128i *tab;
+  __m256i  xEv, mpv, sv, rsc, ilo, ihi;
+  uint64_t ov;
+  int      j, k;
+
+  //a refilled lane starts from an all zero previous row
+  if (freshmask)
+    for (k = 1; k <= om->M; k++) dp[k] = _mm256_andnot_si256(freshv, dp[k]);
+
+  do
+  {
+    (*row)++;
+    for (j = 0; j < 32; j++) { mb->r[j] = *mb->p[j]; mb->p[j] += mb->step[j]; }
+    ilo = _mm256_add_epi8(_mm256_loadu_si256((__m256i *) mb->r), lo_off);
+    ihi = _mm256_sub_epi8(_mm256_loadu_si256((__m256i *) mb->r), hi_off);
+
+    xEv = _mm256_setzero_si256();
+    mpv = _mm256_setzero_si256();
+    //pshufb looks up within each 128 bit half, so the 16 entry tables are broadcast to both
+    for (k = 1, tab = mb->tab + 2; k <= om->M; k++, tab += 2)
+    {
+      rsc   = _mm256_or_si256(_mm256_shuffle_epi8(_mm256_broadcastsi128_si256(tab[0]), ilo),
+                              _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(tab[1]), ihi));
+      sv    = _mm256_max_epu8(mpv, xBv);
+      sv    = _mm256_adds_epu8(sv, biasv);
+      sv    = _mm256_subs_epu8(sv, rsc);
+      xEv   = _mm256_max_epu8(xEv, sv);
+      mpv   = dp[k];
+      dp[k] = sv;
+    }
+
+    ov  = (uint64_t) (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_adds_epu8(xEv, biasv), ceilv)) & activemask;
+
+    xEv = _mm256_subs_epu8(xEv, tecv);
+    xJv = _mm256_max_epu8(xJv, xEv);
+    xBv = _mm256_max_epu8(basev, xJv);
+    xBv = _mm256_subs_epu8(xBv, tjbmv);
+  } while (! ov && *row != next);
+
+  _mm256_storeu_si256((__m256i *) mb->xB, xBv);
+  _mm256_storeu_si256((__m256i *) mb->xJ, xJv);
+  return ov;
+}
+
+#ifdef HAVE_MSV_AVX512
+__attribute__((target("avx512f,avx512bw")))
+static uint64_t msv_rows_avx512(MSV_BATCH *mb, const P7_OPROFILE *om, int64_t *row, int64_t next, uint64_t activemask, uint64_t freshmask)
+{
+  __m512i  biasv = _mm512_set1_epi8((int8_t) om->bias_b);
+  __m512i  tecv  = _mm512_set1_epi8((int8_t) om->tec_b);
+  __m512i  basev = _mm512_set1_epi8((int8_t) om->base_b);
+  __m512i  ceilv = _mm512_set1_epi8((int8_t) 0xff);
+  __m512i  lo_off = _mm512_set1_epi8(0x70), hi_off = _mm512_set1_epi8(0x10);
+  __m512i  xBv   = _mm512_loadu_si512(mb->xB);
+  __m512i  xJv   = _mm512_loadu_si512(mb->xJ);
+  __m512i  freshv = _mm512_loadu_si512(mb->fresh);
+  __m512i  tjbmv = _mm512_loadu_si512(mb->tjbm);
+  __m512i *dp    = (__m512i *) mb->dp;
+  __m128i *tab;
+  __m512i  xEv, mpv, sv, rsc, ilo, ihi;
+  uint64_t ov;
+  int      j, k;
+
+  //a refilled lane starts from an all zero previous row
+  if (freshmask)
+    for (k = 1; k <= om->M; k++) dp[k] = _mm512_andnot_si512(freshv, dp[k]);
+
+  do
+  {
+    (*row)++;
+    for (j = 0; j < 64; j++) { mb->r[j] = *mb->p[j]; mb->p[j] += mb->step[j]; }
+    ilo = _mm512_add_epi8(_mm512_loadu_si512(mb->r), lo_off);
+    ihi = _mm512_sub_epi8(_mm512_loadu_si512(mb->r), hi_off);
+
+    xEv = _mm512_setzero_si512();
+    mpv = _mm512_setzero_si512();
+    for (k = 1, tab = mb->tab + 2; k <= om->M; k++, tab += 2)
+    {
+      rsc   = _mm512_or_si512(_mm512_shuffle_epi8(_mm512_broadcast_i32x4(tab[0]), ilo),
+                              _mm512_shuffle_epi8(_mm512_broadcast_i32x4(tab[1]), ihi));
+      sv    = _mm512_max_epu8(mpv, xBv);
+      sv    = _mm512_adds_epu8(sv, biasv);
+      sv    = _mm512_subs_epu8(sv, rsc);
+      xEv   = _mm512_max_epu8(xEv, sv);
+      mpv   = dp[k];
+      dp[k] = sv;
+    }
+
+    ov  = (uint64_t) _mm512_cmpeq_epi8_mask(_mm512_adds_epu8(xEv, biasv), ceilv) & activemask;
+
+    xEv = _mm512_subs_epu8(xEv, tecv);
+    xJv = _mm512_max_epu8(xJv, xEv);
+    xBv = _mm512_max_epu8(basev, xJv);
+    xBv = _mm512_subs_epu8(xBv, tjbmv);
+  } while (! ov && *row != next);
+
+  _mm512_storeu_si512(mb->xB, xBv);
+  _mm512_storeu_si512(mb->xJ, xJv);
+  return ov;
+}
+#endif /*HAVE_MSV_AVX512*/
+
+//decide MSV pass/fail for the records sb->rec[lo..lo+n-1] into mb->pass[]. n <= MSV_WINDOW
+static void msv_batch_Run(MSV_BATCH *mb, P7_OPROFILE *om, P7_BG *bg, const SEQ_BUFFER *sb, int lo, int n, double F1)
+{
+  static const ESL_DSQ idle_res = 0;
+  const HPC_SEQDB_ENTRY *e = sb->rec + lo;
+  int            who[MSV_MAXLANES];    //window index of the lane's sequence, -1 when idle
+  int64_t        last[MSV_MAXLANES];   //row on which the lane's sequence ends
+  uint8_t        tjb[MSV_MAXLANES];
+  int64_t        row = 0, next = INT64_MAX;
+  uint64_t       activemask = 0, freshmask, ov;
+  int            nextseq = 0, active = 0;
+  int            W = mb->W;
+  int            j, k;
+
+  for (k = 0; k < n; k++) mb->pass[k] = TRUE;   //empty and overlong targets are left to p7_Pipeline
+
+  for (j = 0; j < W; j++)
+  {
+    who[j] = -1; mb->p[j] = &idle_res; mb->step[j] = 0; last[j] = INT64_MAX; tjb[j] = 0;
+    mb->xB[j] = mb->xJ[j] = mb->tjbm[j] = mb->fresh[j] = 0;
+  }
+
+  while (1)
+  {
+    //fill idle lanes. the first pass through here is the initial load
+    freshmask = 0;
+    for (j = 0; j < W && nextseq < n; j++)
+    {
+      if (who[j] >= 0) continue;
+      while (nextseq < n && (e[nextseq].len == 0 || e[nextseq].len > MSV_MAXLEN)) nextseq++;
+      if (nextseq == n) break;
+
+      who[j]      = nextseq;
+      mb->p[j]    = sb->res + e[nextseq].dsq_off + 1;
+      mb->step[j] = 1;
+      last[j]     = row + e[nextseq].len;
+      tjb[j]      = msv_tjb(om, e[nextseq].len);
+      mb->tjbm[j] = (uint8_t) (tjb[j] + om->tbm_b);
+      mb->xJ[j]   = 0;
+      mb->xB[j]   = (om->base_b > mb->tjbm[j]) ? om->base_b - mb->tjbm[j] : 0;
+      mb->fresh[j] = 0xff;
+      freshmask   |= (uint64_t) 1 << j;
+      activemask |= (uint64_t) 1 << j;
+      active++;
+      nextseq++;
+    }
+    if (active == 0) break;
+
+    next = INT64_MAX;
+    for (j = 0; j < W; j++) if (who[j] >= 0 && last[j] < next) next = last[j];
+
+    switch (mb->level)
+    {
+#ifdef HAVE_MSV_AVX512
+      case SIMD_AVX512: ov = msv_rows_avx512(mb, om, &row, next, activemask, freshmask); break;
+#endif
+      case SIMD_AVX2:   ov = msv_rows_avx2  (mb, om, &row, next, activemask, freshmask); break;
+      default:          ov = msv_rows_sse   (mb, om, &row, next, activemask, freshmask); break;
+    }
+    if (freshmask) memset(mb->fresh, 0, W);
+
+    for (j = 0; j < W; j++)
+    {
+      int ovj = (ov >> j) & 1;
+
+      if (who[j] < 0 || (! ovj && last[j] != row)) continue;
+      if (! ovj) mb->pass[who[j]] = msv_batch_Decide(om, bg, sb->res + e[who[j]].dsq_off, e[who[j]].len, mb->xJ[j], tjb[j], F1);
+
+      who[j] = -1; mb->p[j] = &idle_res; mb->step[j] = 0; last[j] = INT64_MAX;
+      activemask &= ~((uint64_t) 1 << j);
+      active--;
+    }
+  }
+}
+#endif /*HAVE_MSV_BATCH*/
+
+//pick the batched filter kernels: the widest the CPU runs, or what --simd asks for
+static int simd_Select(ESL_GETOPTS *go)
+{
+  const char *req  = esl_opt_GetString(go, "--simd");
+  int         best = SIMD_NONE;
+  int         level;
+
+#ifdef HAVE_MSV_BATCH
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("ssse3"))    best = SIMD_SSE;
+  if (__builtin_cpu_supports("avx2"))     best = SIMD_AVX2;
+#ifdef HAVE_MSV_AVX512
+  if (__builtin_cpu_supports("avx512bw")) best = SIMD_AVX512;
+#endif
+#endif
+
+  if (esl_opt_GetBoolean(go, "--nomsvbatch")) return SIMD_NONE;
+  if (strcmp(req, "auto") == 0)               return best;
+
+  for (level = SIMD_NONE; level <= SIMD_AVX512; level++)
+    if (strcmp(req, simd_name[level]) == 0) break;
+  if (level > SIMD_AVX512) p7_Fail("--simd: unknown instruction set %s (auto, sse, avx2, avx512 or none)\n", req);
+  if (level > best)        p7_Fail("--simd %s: not supported by this CPU or this build\n", req);
+  return level;
+}
+
+//--numa: the nodes that have cpus, at most one per thread, and threads dealt to them in blocks
+static NUMA_INFO *numa_Create(int nthreads)
+{
+#ifdef HAVE_LIBNUMA
+  NUMA_INFO      *numa = NULL;
+  struct bitmask *cpus = NULL;
+  int             n, k, t;
+
+  if (numa_available() < 0) p7_Fail("--numa: this system has no NUMA support\n");
+
+  if ((numa             = malloc(sizeof(NUMA_INFO))) == NULL) goto ERROR;
+  if ((numa->id         = malloc(sizeof(int) * (numa_max_node() + 1))) == NULL) goto ERROR;
+  if ((numa->node       = malloc(sizeof(int) * nthreads)) == NULL) goto ERROR;
+  if ((numa->first      = malloc(sizeof(int) * (nthreads + 1))) == NULL) goto ERROR;
+  if ((numa->local      = malloc(sizeof(int64_t) * nthreads)) == NULL) goto ERROR;
+  if ((numa->remote     = malloc(sizeof(int64_t) * nthreads)) == NULL) goto ERROR;
+  if ((numa->seq_local  = malloc(sizeof(int64_t) * nthreads)) == NULL) goto ERROR;
+  if ((numa->seq_remote = malloc(sizeof(int64_t) * nthreads)) == NULL) goto ERROR;
+  if ((numa->om_local   = malloc(sizeof(int64_t) * nthreads)) == NULL) goto ERROR;
+  if ((numa->om_remote  = malloc(sizeof(int64_t) * nthreads)) == NULL) goto ERROR;
+
+  cpus = numa_allocate_cpumask();
+  numa->nnodes = 0;
+  for (n = 0; n <= numa_max_node(); n++)
+    if (numa_node_to_cpus(n, cpus) == 0 && numa_bitmask_weight(cpus) > 0) numa->id[numa->nnodes++] = n;
+  numa_free_cpumask(cpus);
+  if (numa->nnodes == 0) p7_Fail("--numa: found no node with cpus\n");
+  numa->nnodes = ESL_MIN(numa->nnodes, nthreads);
+
+  for (t = 0; t < nthreads; t++)
+  {
+    numa->node[t]  = (int) ((int64_t) t * numa->nnodes / nthreads);
+    numa->local[t]     = numa->remote[t]     = 0;
+    numa->seq_local[t] = numa->seq_remote[t] = 0;
+    numa->om_local[t]  = numa->om_remote[t]  = 0;
+  }
+  for (k = 0; k <= numa->nnodes; k++)
+    numa->first[k] = (int) (((int64_t) k * nthreads + numa->nnodes - 1) / numa->nnodes);
+  return numa;
+
+ERROR:
+  p7_Fail("Failed to allocate NUMA layout\n");
+  return NULL;
+#else
+  p7_Fail("--numa: this build has no NUMA support (compile with -DHAVE_LIBNUMA and link with -lnuma)\n");
+  return NULL;
+#endif
+}
+
+static void numa_Destroy(NUMA_INFO *numa)
+{
+  if (numa == NULL) return;
+  free(numa->id);
+  free(numa->node);
+  free(numa->first);
+  free(numa->local);
+  free(numa->remote);
+  free(numa->seq_local);
+  free(numa->seq_remote);
+  free(numa->om_local);
+  free(numa->om_remote);
+  free(numa);
+}
+
+//called by every thread at the top of a parallel region. libgomp keeps the same threads from one
+//region to the next, so this only moves anything the first time
+static void numa_Pin(NUMA_INFO *numa)
+{
+#ifdef HAVE_LIBNUMA
+  if (numa) numa_run_on_node(numa->id[numa->node[omp_get_thread_num()]]);
+#endif
+}
+
+//where the memory a tile just read really is: the kernel is asked (numa_move_pages with no target nodes
+//only reports) for the nodes of NUMA_SAMPLES pages of the tile's targets and of the profile copy it used.
+//pages the kernel can't place (not resident) aren't counted
+#define NUMA_SAMPLES 4
+static void numa_Sample(NUMA_INFO *numa, int t, HMM_BUFFER *hb, SEQ_BUFFER *sb, int start, int end)
+{
+#ifdef HAVE_LIBNUMA
+  void        *page[NUMA_SAMPLES + 1];
+  int          where[NUMA_SAMPLES + 1];
+  uintptr_t    mask = ~((uintptr_t) numa_pagesize() - 1);
+  int          home = numa->id[numa->node[t]];
+  P7_OPROFILE *om   = (hb->om_node && hb->om_node[numa->node[t]]) ? hb->om_node[numa->node[t]] : hb->om;
+  int          n, s;
+
+  for (n = 0; n < NUMA_SAMPLES && n < end - start; n++)
+    page[n] = (void *) ((uintptr_t) (sb->res + sb->rec[start + (int) ((int64_t) (end - start) * n / NUMA_SAMPLES)].dsq_off) & mask);
+  page[n++] = (void *) ((uintptr_t) om->rbv[0] & mask);
+  if (numa_move_pages(0, n, page, NULL, where, 0) != 0) return;
+
+  for (s = 0; s < n; s++)
+  {
+    if      (where[s] < 0)  continue;
+    else if (s == n - 1)    { if (where[s] == home) numa->om_local[t]++;  else numa->om_remote[t]++;  }
+    else                    { if (where[s] == home) numa->seq_local[t]++; else numa->seq_remote[t]++; }
+  }
+#endif
+}
+
+//the scheduler's share of work run on the node that owns its slice (in residues x model positions, which is what
+//the filters stream through), and then the placement the kernel reported for the sampled pages
+static void numa_Report(NUMA_INFO *numa, int nthreads, FILE *fp)
+{
+  int64_t local = 0, remote = 0;
+  int64_t sl = 0, sr = 0, pl = 0, pr = 0;
+  int     k, t;
+
+  for (t = 0; t < nthreads; t++)
+  {
+    local += numa->local[t];     remote += numa->remote[t];
+    sl    += numa->seq_local[t]; sr     += numa->seq_remote[t];
+    pl    += numa->om_local[t];  pr     += numa->om_remote[t];
+  }
+
+  fprintf(fp, "# NUMA: %d node%s:", numa->nnodes, numa->nnodes > 1 ? "s" : "");
+  for (k = 0; k < numa->nnodes; k++) fprintf(fp, " node %d threads %d-%d%s", numa->id[k], numa->first[k], numa->first[k+1] - 1, k < numa->nnodes - 1 ? "," : "\n");
+  fprintf(fp, "# NUMA: scheduling: work run on its slice's node %lld, on another %lld (%.1f%% on its node)\n", (long long) local, (long long) remote,
+          local + remote > 0 ? 100. * local / (local + remote) : 100.);
+  fprintf(fp, "# NUMA: placement, sampled pages on the reading thread's node: targets %lld of %lld (%.1f%%), profiles %lld of %lld (%.1f%%)\n",
+          (long long) sl, (long long) (sl + sr), sl + sr > 0 ? 100. * sl / (sl + sr) : 100.,
+          (long long) pl, (long long) (pl + pr), pl + pr > 0 ? 100. * pl / (pl + pr) : 100.);
+}
+
+static double thread_cpu(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+static RUN_STATS *stats_Create(FILE *fp, int nthreads)
+{
+  RUN_STATS *rs = NULL;
+
+  if ((rs = malloc(sizeof(RUN_STATS))) == NULL) goto ERROR;
+  memset(rs, 0, sizeof(RUN_STATS));
+  rs->fp       = fp;
+  rs->nthreads = nthreads;
+  rs->t0       = omp_get_wtime();
+  if ((rs->st     = calloc(nthreads * ST_NSTAGES, sizeof(STAGE_TIME))) == NULL) goto ERROR;
+  if ((rs->tiles  = calloc(nthreads, sizeof(uint64_t))) == NULL) goto ERROR;
+  if ((rs->steals = calloc(nthreads, sizeof(uint64_t))) == NULL) goto ERROR;
+  if ((rs->splits = calloc(nthreads, sizeof(uint64_t))) == NULL) goto ERROR;
+  return rs;
+
+ERROR:
+  p7_Fail("Failed to allocate run statistics\n");
+  return NULL;
+}
+
+static void stats_Destroy(RUN_STATS *rs)
+{
+  int k;
+
+  if (rs == NULL) return;
+  if (rs->fp) fclose(rs->fp);
+  if (rs->trace)
+  {
+    for (k = 0; k < rs->trace->nname; k++) free(rs->trace->name[k]);
+    free(rs->trace->name);
+    free(rs->trace->ev);
+    free(rs->trace->nev);
+    free(rs->trace->nextid);
+    free(rs->trace->pending);
+    free(rs->trace->file);
+    free(rs->trace);
+  }
+  free(rs->st);
+  free(rs->tiles);
+  free(rs->steals);
+  free(rs->splits);
+  free(rs);
+}
+
+//t[0] and t[1] are the wall clock and this thread's cpu clock when the stage began
+static void stats_Start(RUN_STATS *rs, double *t)
+{
+  if (rs == NULL) return;
+  t[0] = omp_get_wtime();
+  t[1] = thread_cpu();
+}
+
+//--trace: a new event id of this thread
+static uint64_t trace_Id(TRACE *tr)
+{
+  int t = omp_get_thread_num();
+  return ((uint64_t) t << 40) | tr->nextid[t]++;
+}
+
+static void trace_Add(TRACE *tr, int stage, double t0, double t1, int name, int start, int end, int64_t residues, uint64_t id, uint64_t parent)
+{
+  int          t = omp_get_thread_num();
+  TRACE_EVENT *e = tr->ev + (size_t) t * TRACE_RING + tr->nev[t]++ % TRACE_RING;
+
+  e->t0       = t0;
+  e->t1       = t1;
+  e->stage    = stage;
+  e->name     = name;
+  e->start    = start;
+  e->end      = end;
+  e->residues = residues;
+  e->id       = id;
+  e->parent   = parent;
+}
+
+//add the time since t to this thread's row, less excl, and restart t for the stage that follows.
+//the trace gets the whole span
+static void stats_Span(RUN_STATS *rs, int stage, double *t, double excl)
+{
+  STAGE_TIME *st;
+  double      w, c;
+
+  if (rs == NULL) return;
+  st = rs->st + omp_get_thread_num() * ST_NSTAGES + stage;
+  w  = omp_get_wtime();
+  c  = thread_cpu();
+  st->calls++;
+  st->wall += w - t[0] - excl;
+  st->cpu  += c - t[1];
+  if (rs->trace && stage != ST_KERNEL) trace_Add(rs->trace, stage, t[0], w, -1, 0, 0, 0, trace_Id(rs->trace), 0);
+  t[0] = w;
+  t[1] = c;
+}
+
+static void stats_Stop(RUN_STATS *rs, int stage, double *t)
+{
+  stats_Span(rs, stage, t, 0.);
+}
+
+//the filter counts of a model whose results have been merged, before it is released
+static void stats_Model(RUN_STATS *rs, HMM_BUFFER *hb)
+{
+  if (rs == NULL) return;
+  #pragma omp critical (run_stats)
+  {
+    rs->nmodels++;
+    rs->nseqs       += hb->pli->nseqs;
+    rs->nres        += hb->pli->nres;
+    rs->n_past_msv  += hb->pli->n_past_msv;
+    rs->n_past_bias += hb->pli->n_past_bias;
+    rs->n_past_vit  += hb->pli->n_past_vit;
+    rs->n_past_fwd  += hb->pli->n_past_fwd;
+    rs->n_output    += hb->pli->n_output;
+    rs->cells       += (double) hb->om->M * hb->pli->nres;
+  }
+}
+
+//--stats: the report, once the search is over
+static void stats_Write(RUN_STATS *rs, OUTPUT_INFO *oi)
+{
+  FILE          *fp   = rs->fp;
+  double         wall = omp_get_wtime() - rs->t0;
+  uint64_t       tiles = 0, steals = 0, splits = 0;
+  struct rusage  ru;
+  int            k, t;
+
+  getrusage(RUSAGE_SELF, &ru);
+  fprintf(fp, "{\n");
+  fprintf(fp, "  \"threads\": %d,\n", rs->nthreads);
+  fprintf(fp, "  \"wall_s\": %.6f,\n", wall);
+  fprintf(fp, "  \"cpu_s\": %.6f,\n", ru.ru_utime.tv_sec + 1e-6 * ru.ru_utime.tv_usec + ru.ru_stime.tv_sec + 1e-6 * ru.ru_stime.tv_usec);
+  fprintf(fp, "  \"max_rss_kb\": %ld,\n", ru.ru_maxrss);
+
+  fprintf(fp, "  \"stages\": {\n");
+  for (k = 0; k < ST_NSTAGES; k++)
+  {
+    STAGE_TIME sum = { 0, 0., 0. };
+    for (t = 0; t < rs->nthreads; t++)
+    {
+      sum.calls += rs->st[t * ST_NSTAGES + k].calls;
+      sum.wall  += rs->st[t * ST_NSTAGES + k].wall;
+      sum.cpu   += rs->st[t * ST_NSTAGES + k].cpu;
+    }
+    fprintf(fp, "    \"%s\": { \"calls\": %llu, \"wall_s\": %.6f, \"cpu_s\": %.6f }%s\n",
+            stage_name[k], (unsigned long long) sum.calls, sum.wall, sum.cpu, k < ST_NSTAGES - 1 ? "," : "");
+  }
+  fprintf(fp, "  },\n");
+
+  fprintf(fp, "  \"per_thread\": [\n");
+  for (t = 0; t < rs->nthreads; t++)
+  {
+    double busy = 0.;
+    for (k = 0; k < ST_NBUSY; k++) busy += rs->st[t * ST_NSTAGES + k].wall;
+    fprintf(fp, "    { \"thread\": %d, \"busy_s\": %.6f, \"idle_s\": %.6f, \"kernel_s\": %.6f, \"tiles\": %llu, \"steals\": %llu, \"splits\": %llu }%s\n",
+            t, busy, ESL_MAX(0., wall - busy), rs->st[t * ST_NSTAGES + ST_KERNEL].wall,
+            (unsigned long long) rs->tiles[t], (unsigned long long) rs->steals[t], (unsigned long long) rs->splits[t], t < rs->nthreads - 1 ? "," : "");
+    tiles  += rs->tiles[t];
+    steals += rs->steals[t];
+    splits += rs->splits[t];
+  }
+  fprintf(fp, "  ],\n");
+
+  fprintf(fp, "  \"tasks\": { \"scheduler\": \"%s\", \"tiles\": %llu, \"steals\": %llu, \"split_tasks\": %llu },\n",
+          oi->sched->mode == SCHED_TILES ? "tiles" : "split", (unsigned long long) tiles, (unsigned long long) steals, (unsigned long long) splits);
+  fprintf(fp, "  \"pipeline\": { \"models\": %llu, \"targets\": %llu, \"residues\": %llu, \"past_msv\": %llu, \"past_bias\": %llu, \"past_vit\": %llu, \"past_fwd\": %llu, \"reported\": %llu },\n",
+          (unsigned long long) rs->nmodels, (unsigned long long) rs->nseqs, (unsigned long long) rs->nres,
+          (unsigned long long) rs->n_past_msv, (unsigned long long) rs->n_past_bias, (unsigned long long) rs->n_past_vit,
+          (unsigned long long) rs->n_past_fwd, (unsigned long long) rs->n_output);
+  fprintf(fp, "  \"throughput\": { \"cells\": %.0f, \"cells_per_s\": %.6g, \"gcups\": %.3f }\n",
+          rs->cells, wall > 0. ? rs->cells / wall : 0., wall > 0. ? rs->cells / wall * 1e-9 : 0.);
+  fprintf(fp, "}\n");
+  if (ferror(fp)) p7_Fail("Failed to write the statistics file\n");
+}
+
+static void trace_Create(RUN_STATS *rs, char *file, int rank, int nranks)
+{
+  TRACE *tr = NULL;
+
+  if ((tr = malloc(sizeof(TRACE))) == NULL) goto ERROR;
+  memset(tr, 0, sizeof(TRACE));
+  //every rank keeps its own trace; the others go next to rank 0's
+  if (nranks > 1 && rank > 0) esl_sprintf(&tr->file, "%s.%d", file, rank);
+  else                        esl_sprintf(&tr->file, "%s", file);
+  tr->pid = rank;
+  if ((tr->ev      = malloc(sizeof(TRACE_EVENT) * TRACE_RING * rs->nthreads)) == NULL) goto ERROR;
+  if ((tr->nev     = calloc(rs->nthreads, sizeof(uint64_t))) == NULL) goto ERROR;
+  if ((tr->nextid  = calloc(rs->nthreads, sizeof(uint64_t))) == NULL) goto ERROR;
+  if ((tr->pending = calloc(rs->nthreads, sizeof(uint64_t))) == NULL) goto ERROR;
+  rs->trace = tr;
+  return;
+
+ERROR:
+  p7_Fail("Failed to allocate the trace buffers\n");
+}
+
+//a model name as the inside of a JSON string: quotes, backslashes and control characters escaped. NULL if
+//out of memory
+static char *trace_Escape(const char *s)
+{
+  char *buf, *b;
+
+  if ((buf = b = malloc(6 * strlen(s) + 1)) == NULL) return NULL;
+  for ( ; *s; s++)
+  {
+    if      (*s == '"' || *s == '\\')       { *b++ = '\\'; *b++ = *s; }
+    else if ((unsigned char) *s < 0x20)     b += sprintf(b, "\\u%04x", (unsigned char) *s);
+    else                                    *b++ = *s;
+  }
+  *b = '\0';
+  return buf;
+}
+
+//the trace's number for a model's name, added the first time one of its kernels ends. names are kept
+//escaped, ready for the JSON
+static int trace_Name(TRACE *tr, HMM_BUFFER *hb)
+{
+  int    n;
+  char **name;
+
+  #pragma omp atomic read
+  n = hb->trace_name;
+  if (n >= 0) return n;
+
+  //no goto out of the critical section: a failed allocation leaves n at -1 and fails after it
+  #pragma omp critical (trace_name)
+  {
+    if (hb->trace_name < 0 && tr->nname == tr->nalloc)
+    {
+      if ((name = realloc(tr->name, sizeof(char *) * (2 * tr->nalloc + 64))) != NULL)
+      {
+        tr->name   = name;
+        tr->nalloc = 2 * tr->nalloc + 64;
+      }
+    }
+    if (hb->trace_name < 0 && tr->nname < tr->nalloc && (tr->name[tr->nname] = trace_Escape(hb->om->name)) != NULL)
+    {
+      #pragma omp atomic write
+      hb->trace_name = tr->nname++;
+    }
+    n = hb->trace_name;
+  }
+  if (n < 0) p7_Fail("Failed to allocate the trace name table\n");
+  return n;
+}
+
+static void trace_Kernel(TRACE *tr, HMM_BUFFER *hb, SEQ_BUFFER *sb, int start, int end, double t0, uint64_t id, uint64_t parent)
+{
+  if (hb->om == NULL) return;
+  trace_Add(tr, ST_KERNEL, t0, omp_get_wtime(), trace_Name(tr, hb), start, end, sb->res_sum[end] - sb->res_sum[start], id, parent);
+}
+
+//ids as strings: JSON readers keep numbers as doubles, which can't hold 64 bits
+static void trace_IdString(uint64_t id, char *buf)
+{
+  if (id & TRACE_BLOCK) sprintf(buf, "b%llu", (unsigned long long) (id & ~TRACE_BLOCK));
+  else                  sprintf(buf, "t%d.%llu", (int) (id >> 40), (unsigned long long) (id & ((UINT64_C(1) << 40) - 1)));
+}
+
+//--trace: Chrome trace-event format, which Perfetto and chrome://tracing open. times are in microseconds from
+//the start of the run. a thread that recorded more than TRACE_RING events only has its last ones
+static void trace_Write(RUN_STATS *rs)
+{
+  TRACE   *tr    = rs->trace;
+  FILE    *fp    = NULL;
+  int      first = TRUE;
+  char     id[32], parent[32];
+  uint64_t n, dropped = 0;
+  int      t;
+
+  if ((fp = fopen(tr->file, "w")) == NULL) p7_Fail("Failed to open trace file %s for writing\n", tr->file);
+  fprintf(fp, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+  for (t = 0; t < rs->nthreads; t++)
+  {
+    fprintf(fp, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": %d, \"args\": {\"name\": \"thread %d\"}}", first ? "" : ",\n", tr->pid, t, t);
+    first = FALSE;
+  }
+
+  for (t = 0; t < rs->nthreads; t++)
+  {
+    n = (tr->nev[t] > TRACE_RING) ? tr->nev[t] - TRACE_RING : 0;
+    dropped += n;
+    for ( ; n < tr->nev[t]; n++)
+    {
+      TRACE_EVENT *e  = tr->ev + (size_t) t * TRACE_RING + n % TRACE_RING;
+      double       ts = 1e6 * (e->t0 - rs->t0);
+
+      trace_IdString(e->id, id);
+      if (e->stage == TR_SPAWN)
+        fprintf(fp, ",\n{\"name\": \"spawn %s\", \"cat\": \"%s\", \"ph\": \"i\", \"s\": \"t\", \"ts\": %.3f, \"pid\": %d, \"tid\": %d, \"args\": {\"id\": \"%s\", \"tiles\": %d}}",
+                id, stage_name[e->stage], ts, tr->pid, t, id, e->end);
+      else if (e->stage == ST_KERNEL)
+      {
+        trace_IdString(e->parent, parent);
+        fprintf(fp, ",\n{\"name\": \"%s\", \"cat\": \"kernel\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": %d, \"tid\": %d, "
+                    "\"args\": {\"id\": \"%s\", \"parent\": \"%s\", \"seqs\": \"%d-%d\", \"nseq\": %d, \"residues\": %lld}}",
+                tr->name[e->name], ts, 1e6 * (e->t1 - e->t0), tr->pid, t, id, parent, e->start, e->end - 1, e->end - e->start, (long long) e->residues);
+      }
+      else
+        fprintf(fp, ",\n{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": %d, \"tid\": %d, \"args\": {\"id\": \"%s\"}}",
+                stage_name[e->stage], e->stage >= ST_WAIT_SLOT ? "wait" : "io", ts, 1e6 * (e->t1 - e->t0), tr->pid, t, id);
+    }
+  }
+  fprintf(fp, "\n], \"otherData\": {\"threads\": %d, \"events_per_thread\": %d, \"dropped\": %llu}}\n", rs->nthreads, TRACE_RING, (unsigned long long) dropped);
+  if (ferror(fp) || fclose(fp) != 0) p7_Fail("Failed to write trace file %s\n", tr->file);
+}
+
+#ifdef HAVE_MSV_BATCH
+//--bench_msv: the first stage alone, striped one target at a time vs batched, over the first hmm and sequence
+//buffers on one thread. every decision of the batched filter is checked against the striped one
+static void benchmark_msv(HMM_BUFFER **hb, int nhmm, SEQ_BUFFER *sb, FILE *ofp)
+{
+  uint8_t *ref    = NULL;
+  double   t[2]   = { 0., 0. };
+  uint64_t nres   = 0, ncells = 0, npass = 0, nmis = 0;
+  int      h, x, lo;
+
+  if ((ref = malloc(sizeof(uint8_t) * (sb->count + 1))) == NULL) goto ERROR;
+
+  for(h = 0; h < nhmm && hb[h]->om != NULL; h++)
+  {
+    P7_OPROFILE *om = p7_oprofile_Copy(hb[h]->om);
+    P7_BG       *bg = p7_bg_Create(om->abc);
+    P7_OMX      *ox = p7_omx_Create(om->M, 0, 0);
+    MSV_BATCH   *mb = msv_batch_Create(simd_level);
+    double       F1 = hb[h]->pli->F1;
+    double       t0;
+    float        usc, nullsc, seq_score;
+
+    if(mb == NULL || msv_batch_Prepare(mb, om) != eslOK) p7_Fail("the batched MSV filter is off or can't handle this alphabet\n");
+
+    t0 = omp_get_wtime();
+    for(x = 0; x < sb->count; x++)
+    {
+      const ESL_DSQ *dsq = sb->res + sb->rec[x].dsq_off;
+      int            L   = sb->rec[x].len;
+      ref[x] = TRUE;
+      if(L == 0 || L > MSV_MAXLEN) continue;
+      p7_bg_SetLength(bg, L);
+      p7_oprofile_ReconfigMSVLength(om, L);
+      p7_MSVFilter(dsq, L, om, ox, &usc);
+      p7_bg_NullOne(bg, dsq, L, &nullsc);
+      seq_score = (usc - nullsc) / eslCONST_LOG2;
+      ref[x] = (esl_gumbel_surv(seq_score, om->evparam[p7_MMU], om->evparam[p7_MLAMBDA]) > F1) ? FALSE : TRUE;
+      nres   += L;
+      ncells += (uint64_t) L * om->M;
+    }
+    t[0] += omp_get_wtime() - t0;
+
+    t0 = omp_get_wtime();
+    for(lo = 0; lo < sb->count; lo += MSV_WINDOW)
+    {
+      int n = ESL_MIN(MSV_WINDOW, sb->count - lo);
+      msv_batch_Run(mb, om, bg, sb, lo, n, F1);
+      for(x = 0; x < n; x++)
+      {
+        if(mb->pass[x] != ref[lo + x]) nmis++;
+        if(sb->rec[lo + x].len > 0 && mb->pass[x]) npass++;
+      }
+    }
+    t[1] += omp_get_wtime() - t0;
+
+    msv_batch_Destroy(mb);
+    p7_omx_Destroy(ox);
+    p7_bg_Destroy(bg);
+    p7_oprofile_Destroy(om);
+  }
+
+  if (fprintf(ofp, "# MSV filter, %d models x %d targets, one thread, %s kernels\n", h, sb->count, simd_name[simd_level])     < 0) goto ERROR;
+  if (fprintf(ofp, "# %-10s %15s %10s %12s %10s\n", "filter", "residues", "seconds", "Mresidues/s", "GCUPS")                  < 0) goto ERROR;
+  for(x = 0; x < 2; x++)
+    if (fprintf(ofp, "  %-10s %15llu %10.3f %12.2f %10.2f\n", x ? "batched" : "striped", (unsigned long long) nres, t[x],
+                (double) nres / t[x] / 1e6, (double) ncells / t[x] / 1e9)                                                    < 0) goto ERROR;
+  if (fprintf(ofp, "# passed F1: %llu   decisions that differ: %llu\n", (unsigned long long) npass, (unsigned long long) nmis) < 0) goto ERROR;
+
+  free(ref);
+  if(nmis) p7_Fail("batched MSV filter disagrees with p7_MSVFilter\n");
+  return;
+
+ERROR:
+  p7_Fail("MSV benchmark failed\n");
+}
+#endif /*HAVE_MSV_BATCH*/
+
+//work unit state for one thread, reset for each work unit instead of being built and torn down.
+//om is a struct copy of the shared profile: its arrays are shared and only read, while the length
+//dependent special transitions that ReconfigLength and domain definition write are this thread's own.
+//the pipeline's DP matrices grow to the largest model and target seen and then stay
+typedef struct
+{
+  P7_OPROFILE  om;
+  P7_PIPELINE *pli;
+  P7_BG       *bg;
+  P7_TOPHITS  *th;
+#ifdef HAVE_MSV_BATCH
+  MSV_BATCH   *mb;
+#endif
+} WORK_STATE;
+
+//a thread can pick up a child task at the task creation point inside a kernel and run it before
+//resuming, so each thread keeps a stack of states rather than just one
+struct work_pool_s
+{
+  WORK_STATE **ws;
+  int          depth;
+  int          alloc;
+};
+
+static WORK_POOL *work_pool_Create(int nthreads)
+{
+  WORK_POOL *pool = NULL;
+
+  if ((pool = calloc(nthreads, sizeof(WORK_POOL))) == NULL) p7_Fail("Failed to allocate the work state pool\n");
+  return pool;
+}
+
+static void work_pool_Destroy(WORK_POOL *pool, int nthreads)
+{
+  int t, d;
+
+  if (pool == NULL) return;
+  for (t = 0; t < nthreads; t++)
+  {
+    for (d = 0; d < pool[t].alloc; d++)
+    {
+      p7_pipeline_Destroy(pool[t].ws[d]->pli);
+      p7_bg_Destroy(pool[t].ws[d]->bg);
+      p7_tophits_Destroy(pool[t].ws[d]->th);
+#ifdef HAVE_MSV_BATCH
+      msv_batch_Destroy(pool[t].ws[d]->mb);
+#endif
+      free(pool[t].ws[d]);
+    }
+    free(pool[t].ws);
+  }
+  free(pool);
+}
+
+//zero what p7_pipeline_Merge adds up. thresholds are reset by p7_pli_NewModel
+static void pipeline_ResetCounts(P7_PIPELINE *pli)
+{
+  pli->nmodels       = pli->nseqs         = pli->nres         = pli->nnodes       = 0;
+  pli->n_past_msv    = pli->n_past_bias   = pli->n_past_vit   = pli->n_past_fwd   = 0;
+  pli->pos_past_msv  = pli->pos_past_bias = pli->pos_past_vit = pli->pos_past_fwd = 0;
+  pli->n_output      = pli->pos_output    = 0;
+  if (pli->Z_setby == p7_ZSETBY_NTARGETS) pli->Z = 0;
+}
+
+//this thread's next free state, set up for a work unit against the shared profile om
+static WORK_STATE *work_state_Get(WORK_POOL *pool, const P7_OPROFILE *om, ESL_GETOPTS *go, ESL_ALPHABET *abc)
+{
+  WORK_POOL  *tp = pool + omp_get_thread_num();
+  WORK_STATE *ws = NULL;
+
+  if (tp->depth == tp->alloc)
+  {
+    if ((tp->ws = realloc(tp->ws, sizeof(WORK_STATE *) * (tp->alloc + 1))) == NULL) goto ERROR;
+    if ((ws     = malloc(sizeof(WORK_STATE))) == NULL) goto ERROR;
+    ws->pli = p7_pipeline_Create(go, om->M, 100, FALSE, p7_SEARCH_SEQS);
+    ws->bg  = p7_bg_Create(abc);
+    ws->th  = p7_tophits_Create();
+#ifdef HAVE_MSV_BATCH
+    ws->mb  = msv_batch_Create(simd_level);
+#endif
+    tp->ws[tp->alloc++] = ws;
+  }
+  ws = tp->ws[tp->depth++];
+
+  ws->om = *om;
+  pipeline_ResetCounts(ws->pli);
+  p7_pli_NewModel(ws->pli, &ws->om, ws->bg);
+  return ws;
+
+ERROR:
+  p7_Fail("Failed to allocate work unit state\n");
+  return NULL;
+}
+
+//give the state back once its hits have been merged away
+static void work_state_Put(WORK_POOL *pool, WORK_STATE *ws)
+{
+  p7_tophits_Reuse(ws->th);
+  pool[omp_get_thread_num()].depth--;
+}
+
+//the first index in [lo, hi] whose residue prefix sum reaches target (hi if none does)
+static int residue_index(SEQ_BUFFER *sb, int lo, int hi, int64_t target)
+{
+  while(lo < hi)
+  {
+    int mid = (lo + hi) / 2;
+    if(sb->res_sum[mid] < target) lo = mid + 1;
+    else                          hi = mid;
+  }
+  return lo;
+}
+
+//split [x, end) at about half of its residues, keeping at least one sequence on each side
+static int split_point(SEQ_BUFFER *sb, int x, int end)
+{
+  return residue_index(sb, x + 1, end - 1, (sb->res_sum[x] + sb->res_sum[end]) / 2);
+}
+
+//a work block (hmm buffer x sequence buffer) is cut into tiles before any of it runs. each model gets
+//tiles in proportion to its estimated cost, M x residues, so a few big models in a buffer of small ones
+//are spread over many threads instead of being the last units running. the tiles are dealt largest
+//first to the least loaded worker (LPT), and a worker whose deque runs dry steals the smallest tile of
+//the worker with the most estimated work left, which evens out the errors of the estimate at the tail
+#define TILES_PER_THREAD 8     //tiles for an average worker (--mem picks its own); the smallest ones even out the end
+#define TILE_MIN_SEQS    256   //smaller tiles leave the batched MSV filter's windows half empty
+
+static int tile_cost_cmp(const void *a, const void *b)
+{
+  const TILE *ta = a, *tb = b;
+
+  if(ta->cost != tb->cost) return (ta->cost < tb->cost) ? 1 : -1;
+  if(ta->hb_idx != tb->hb_idx) return ta->hb_idx - tb->hb_idx;
+  return ta->start - tb->start;
+}
+
+static TILE_SCHED *tile_sched_Create(int nworkers, int mode, NUMA_INFO *numa)
+{
+  TILE_SCHED *ts = NULL;
+  int         w;
+
+  if ((ts = malloc(sizeof(TILE_SCHED))) == NULL) goto ERROR;
+  ts->tile     = NULL;
+  ts->slot     = NULL;
+  ts->ntiles   = ts->talloc = 0;
+  ts->nworkers = nworkers;
+  ts->mode     = mode;
+  ts->busy     = NULL;
+  ts->done     = NULL;
+  ts->active   = 0;
+  ts->hb       = NULL;
+  ts->sb       = NULL;
+  ts->refs[0]  = ts->refs[1] = NULL;
+  ts->numa     = numa;
+  ts->stats    = NULL;
+  ts->block    = 0;
+  ts->per_thread = TILES_PER_THREAD;
+  if ((ts->dq = malloc(sizeof(TILE_DEQUE) * nworkers)) == NULL) goto ERROR;
+  for(w = 0; w < nworkers; w++)
+  {
+    omp_init_lock(&ts->dq[w].lock);
+    ts->dq[w].head = ts->dq[w].tail = 0;
+    ts->dq[w].left = 0.;
+  }
+  return ts;
+
+ERROR:
+  p7_Fail("Failed to allocate the work scheduler\n");
+  return NULL;
+}
+
+static void tile_sched_Destroy(TILE_SCHED *ts)
+{
+  int w;
+
+  if(ts == NULL) return;
+  for(w = 0; w < ts->nworkers; w++) omp_destroy_lock(&ts->dq[w].lock);
+  free(ts->dq);
+  free(ts->tile);
+  free(ts->slot);
+  free(ts->busy);
+  free(ts->done);
+  free(ts);
+}
+
+//cut the block into tiles and deal them to the worker deques
+static void tile_sched_Plan(TILE_SCHED *ts, HMM_BUFFER **hb, int nhmm, SEQ_BUFFER *sb)
+{
+  int64_t R     = sb->res_sum[sb->count];
+  double  total = 0.;
+  double  target;
+  int     x, k, w, t;
+
+  ts->hb     = hb;
+  ts->nhmm   = nhmm;
+  ts->sb     = sb;
+  ts->ntiles = 0;
+  for(w = 0; w < ts->nworkers; w++) ts->dq[w].head = ts->dq[w].tail = 0, ts->dq[w].left = 0.;
+  if(sb->count == 0 || R == 0) return;
+
+  for(x = 0; x < nhmm; x++)
+    if(hb[x]->om != NULL) total += (double) hb[x]->om->M * R;
+  target = total / (ts->nworkers * ts->per_thread);
+
+  for(x = 0; x < nhmm; x++)
+  {
+    int n;
+
+    if(hb[x]->om == NULL) continue;
+    n = (int) ((double) hb[x]->om->M * R / target + 0.5);
+    n = ESL_MAX(1, ESL_MIN(n, sb->count / TILE_MIN_SEQS));
+
+    if(ts->ntiles + n + sb->nslices > ts->talloc)
+    {
+      ts->talloc = 2 * (ts->ntiles + n + sb->nslices);
+      if ((ts->tile = realloc(ts->tile, sizeof(TILE) * ts->talloc)) == NULL) goto ERROR;
+      if ((ts->slot = realloc(ts->slot, sizeof(int) * ts->talloc * ts->nworkers)) == NULL) goto ERROR;
+    }
+
+    //n pieces of about equal residue count, none of them across a slice boundary
+    for(k = 0; k < sb->nslices; k++)
+    {
+      int     lo   = ESL_MIN(sb->slice[k],   sb->count);
+      int     hi   = ESL_MIN(sb->slice[k+1], sb->count);
+      int64_t base = sb->res_sum[lo];
+      int64_t Rk   = sb->res_sum[hi] - base;
+      int     nk, j, start;
+
+      if(Rk == 0) continue;
+      nk = n;
+      if(sb->nslices > 1) nk = ESL_MAX(1, ESL_MIN((int) ((double) n * Rk / R + 0.5), (hi - lo) / TILE_MIN_SEQS));
+
+      for(j = 1, start = lo; j <= nk; j++)
+      {
+        int   end = (j == nk) ? hi : residue_index(sb, start, hi, base + Rk / nk * j + Rk % nk * j / nk);
+        TILE *tl  = ts->tile + ts->ntiles;
+
+        if(end <= start) continue;
+        tl->hb_idx = x;
+        tl->start  = start;
+        tl->end    = end;
+        tl->node   = k;
+        tl->cost   = (double) hb[x]->om->M * (sb->res_sum[end] - sb->res_sum[start]);
+        ts->ntiles++;
+        start = end;
+      }
+    }
+  }
+
+  qsort(ts->tile, ts->ntiles, sizeof(TILE), tile_cost_cmp);
+
+  //each deque ends up in decreasing cost order with about the same total. with --numa a tile
+  //only goes to the threads on its slice's node
+  for(w = 0; w < ts->nworkers; w++) ts->dq[w].tile = ts->slot + w * ts->talloc;
+  for(t = 0; t < ts->ntiles; t++)
+  {
+    int lo    = ts->numa ? ts->numa->first[ts->tile[t].node]     : 0;
+    int hi    = ts->numa ? ts->numa->first[ts->tile[t].node + 1] : ts->nworkers;
+    int least = lo;
+    for(w = lo + 1; w < hi; w++)
+      if(ts->dq[w].left < ts->dq[least].left) least = w;
+    ts->dq[least].tile[ts->dq[least].tail++] = t;
+    ts->dq[least].left += ts->tile[t].cost;
+  }
+  return;
+
+ERROR:
+  p7_Fail("Failed to allocate work tiles\n");
+}
+
+//the next tile for worker w: the biggest of its own, or else one stolen from the back of the
+//deque with the most estimated work left. -1 when every deque is empty.
+//w is -1 for a thread that only helps out, see ring_wait
+static int tile_Take(TILE_SCHED *ts, int w)
+{
+  TILE_DEQUE *dq;
+  int         t  = -1;
+  int         v;
+
+  if(w >= 0)
+  {
+    dq = ts->dq + w;
+    omp_set_lock(&dq->lock);
+    if(dq->head < dq->tail)
+    {
+      t = dq->tile[dq->head++];
+      #pragma omp atomic
+      dq->left -= ts->tile[t].cost;
+    }
+    omp_unset_lock(&dq->lock);
+  }
+
+  while(t < 0)
+  {
+    TILE_DEQUE *victim = NULL;
+    double      most   = 0.;
+    int         near   = 0;
+    int         home   = ts->numa ? ts->numa->node[w >= 0 ? w : omp_get_thread_num()] : 0;
+
+    //left is only a hint here, read without the owner's lock.
+    //with --numa a deque on the thief's own node is robbed before any other
+    for(v = 0; v < ts->nworkers; v++)
+    {
+      double left;
+      int    local = (ts->numa == NULL || ts->numa->node[v] == home);
+      #pragma omp atomic read
+      left = ts->dq[v].left;
+      if(v == w || left <= 0.) continue;
+      if(victim == NULL || local > near || (local == near && left > most)) { most = left; victim = ts->dq + v; near = local; }
+    }
+    if(victim == NULL) return -1;
+
+    omp_set_lock(&victim->lock);
+    if(victim->head < victim->tail)
+    {
+      t = victim->tile[--victim->tail];
+      if(ts->stats) ts->stats->steals[omp_get_thread_num()]++;
+      #pragma omp atomic
+      victim->left -= ts->tile[t].cost;
+    }
+    else
+    {
+      #pragma omp atomic write
+      victim->left = 0.;   //only rounding was left
+    }
+    omp_unset_lock(&victim->lock);
+  }
+  return t;
+}
+
+//the block's counts drop by one for each tile that is finished
+static void tile_Done(TILE_SCHED *ts)
+{
+  int k;
+
+  #pragma omp flush
+  for(k = 0; k < 2; k++)
+    if(ts->refs[k] != NULL)
+    {
+      #pragma omp atomic
+      *ts->refs[k] -= 1;
+    }
+}
+
+static void tile_Run(TILE_SCHED *ts, int t, ESL_GETOPTS *go, OUTPUT_INFO *oi)
+{
+  TILE *tl = ts->tile + t;
+
+  if(ts->stats && ts->stats->trace) ts->stats->trace->pending[omp_get_thread_num()] = ts->block;
+  thread_kernel(ts->hb[tl->hb_idx], ts->sb, tl->start, tl->end, go, oi);
+  if(ts->stats) ts->stats->tiles[omp_get_thread_num()]++;
+  if(ts->numa && ts->hb[tl->hb_idx]->om)
+  {
+    int     me   = omp_get_thread_num();
+    int64_t work = (int64_t) ts->hb[tl->hb_idx]->om->M * (ts->sb->res_sum[tl->end] - ts->sb->res_sum[tl->start]);
+
+    if(ts->numa->node[me] == tl->node) ts->numa->local[me]  += work;
+    else                               ts->numa->remote[me] += work;
+    numa_Sample(ts->numa, me, ts->hb[tl->hb_idx], ts->sb, tl->start, tl->end);
   }
+  tile_Done(ts);
+}
 
-  return sstatus;
+//spawn one worker task per thread for the planned block. with a single thread they run right away,
+//since nothing else would ever pick them up while the control thread is busy.
+//with --numa a worker starts on the deque of the thread it runs on, which holds that node's tiles
+static void tile_sched_Start(TILE_SCHED *ts, ESL_GETOPTS *go, OUTPUT_INFO *oi)
+{
+  int w;
+
+  ts->active = ts->nworkers;
+  for(w = 0; w < ts->nworkers; w++)
+  {
+    #pragma omp task if(oi->threads > 1)
+    {
+      int me = ts->numa ? omp_get_thread_num() : w;
+      int t;
+      while((t = tile_Take(ts, me)) >= 0) tile_Run(ts, t, go, oi);
+      #pragma omp atomic
+      ts->active -= 1;
+    }
+  }
 }
 
-//load from a hmm file into the given hmm buffer
-//return eslOK if the hmm buffer was filled completely. 
-//partial buffers are padded with NULL oprofiles
-//or whatever state they are in after being Reused()
-//return eslEOF if the buffer was partially filled with new data
-static int load_hmm_buffer(P7_HMMFILE *hfp, HMM_BUFFER **hb, int *nquery, int buffer_size, ESL_ALPHABET *abc, ESL_GETOPTS *go)
+//spawn the tasks for every model in hb against sb. called inside the taskgroup that waits for them
+static void run_work_block(TILE_SCHED *ts, HMM_BUFFER **hb, int nhmm, SEQ_BUFFER *sb, ESL_GETOPTS *go, OUTPUT_INFO *oi)
 {
-  int x;
-  int hstatus = eslOK;
+  int hb_idx;
 
-  P7_HMM *hmm = NULL;
-  P7_PROFILE *gm = NULL;
-  
-  for(x = 0; x < buffer_size; x++)
+  if(ts->mode == SCHED_TILES)
   {
-    hstatus = p7_hmmfile_Read(hfp, &abc, &hmm);
+    tile_sched_Plan(ts, hb, nhmm, sb);
+    tile_sched_Start(ts, go, oi);
+    return;
+  }
 
-    switch (hstatus)
+  //--sched split: one unit per model, halved while fewer units than threads remain.
+  //blocks can overlap, so the counter is never reset: every unit takes itself off when it ends
+  for(hb_idx = 0; hb_idx < nhmm; hb_idx++)
+  {
+    #pragma omp atomic
+    work_counter++;
+    #pragma omp task
     {
-      case eslEOD      : p7_Fail("read failed, HMM file may be truncated?"); break;
-      case eslEFORMAT  : p7_Fail("bad file format in HMM file "           ); break;
-      case eslEINCOMPAT: p7_Fail("HMM file contains different alphabets"  ); break;
-      case eslEOF      :                                                     break;
-      case eslOK       :       
-        *nquery++;
-        gm = p7_profile_Create(hmm->M, abc);
-        hb[x]->om = p7_oprofile_Create(hmm->M, abc);
-        hb[x]->bg = p7_bg_Create(abc);
-        p7_ProfileConfig(hmm, hb[x]->bg, gm, 10, p7_LOCAL);
-        p7_oprofile_Convert(gm, hb[x]->om);
-        //this pipeline never actually gets used, it's just merged statistics counts from
-        //all the worker copies. it needs no dp working memory
-        hb[x]->pli = p7_pipeline_Create(go, 1, 1, FALSE, p7_SEARCH_SEQS);
+      if(ts->stats && ts->stats->trace) ts->stats->trace->pending[omp_get_thread_num()] = ts->block;
+      thread_kernel(hb[hb_idx], sb, 0, sb->count, go, oi);
+    }
+  }
+}
 
-        hb[x]->th = p7_tophits_Create();
-        p7_pli_NewModel(hb[x]->pli, hb[x]->om, hb[x]->bg);
+static SEQ_RING *seq_ring_Create(SEQ_SOURCE *src, int nslots, int size, size_t budget, int sort, ESL_ALPHABET *abc, int nworkers, int mode, NUMA_INFO *numa)
+{
+  SEQ_RING *ring = NULL;
+  int       i;
 
-        p7_hmm_Destroy(hmm);
-        p7_profile_Destroy(gm);
-        break;
-      default:
-        p7_Fail("Unexpected error (%d) in reading HMMs", hstatus);
+  if ((ring = malloc(sizeof(SEQ_RING))) == NULL) goto ERROR;
+  ring->nslots  = nslots;
+  ring->nts     = nslots + 1;   //two blocks of one slot can be in flight when the database fits in it
+  ring->nblocks = 0;
+  if ((ring->slot = malloc(sizeof(SEQ_SLOT) * ring->nslots)) == NULL) goto ERROR;
+  if ((ring->ts   = malloc(sizeof(TILE_SCHED *) * ring->nts)) == NULL) goto ERROR;
+  for(i = 0; i < ring->nslots; i++)
+  {
+    ring->slot[i].sb     = seq_buffer_Create(src, size, budget, sort, abc, numa);
+    ring->slot[i].refs   = 0;
+    ring->slot[i].eof    = FALSE;
+    ring->slot[i].cached = FALSE;
+  }
+  for(i = 0; i < ring->nts; i++) ring->ts[i] = tile_sched_Create(nworkers, mode, numa);
+  return ring;
+
+ERROR:
+  p7_Fail("Failed to allocate the sequence buffer ring\n");
+  return NULL;
+}
+
+static void seq_ring_Destroy(SEQ_RING *ring)
+{
+  int i;
+
+  if(ring == NULL) return;
+  for(i = 0; i < ring->nslots; i++) if(! ring->slot[i].cached) seq_buffer_Destroy(ring->slot[i].sb);
+  for(i = 0; i < ring->nts; i++)    tile_sched_Destroy(ring->ts[i]);
+  free(ring->slot);
+  free(ring->ts);
+  free(ring);
+}
+
+static SEQ_CACHE *seq_cache_Create(size_t cap, int nslots, int size, size_t budget, int sort, ESL_ALPHABET *abc, NUMA_INFO *numa)
+{
+  SEQ_CACHE *sc = NULL;
+
+  if ((sc = malloc(sizeof(SEQ_CACHE))) == NULL) goto ERROR;
+  sc->buf       = NULL;
+  sc->eof       = NULL;
+  sc->n         = 0;
+  sc->alloc     = 0;
+  sc->bytes     = 0;
+  sc->cap       = cap;
+  sc->admitting = TRUE;
+  sc->next      = 0;
+  sc->nspare    = 0;
+  sc->size      = size;
+  sc->budget    = budget;
+  sc->sort      = sort;
+  sc->abc       = abc;
+  sc->numa      = numa;
+  if ((sc->spare = malloc(sizeof(SEQ_BUFFER *) * nslots)) == NULL) goto ERROR;
+  return sc;
+
+ERROR:
+  p7_Fail("Failed to allocate the sequence buffer cache\n");
+  return NULL;
+}
+
+static void seq_cache_Destroy(SEQ_CACHE *sc)
+{
+  int i;
+
+  if(sc == NULL) return;
+  for(i = 0; i < sc->n; i++)      seq_buffer_Destroy(sc->buf[i]);
+  for(i = 0; i < sc->nspare; i++) seq_buffer_Destroy(sc->spare[i]);
+  free(sc->buf);
+  free(sc->eof);
+  free(sc->spare);
+  free(sc);
+}
+
+//back to the start of a pass, for a search that doesn't follow on from the last
+static void seq_cache_Rewind(SEQ_CACHE *sc, SEQ_SOURCE *src)
+{
+  seq_source_Rewind(src);
+  if(sc) sc->next = 0;
+}
+
+//fill a slot with the next buffer of the pass: from the cache if it has it, otherwise loaded from the source,
+//and on the first pass kept if it fits. without a cache this is just load_seq_buffer. the slot is idle
+static void seq_cache_Next(SEQ_CACHE *sc, SEQ_SOURCE *src, SEQ_SLOT *ss)
+{
+  SEQ_POS pos;
+  size_t  need;
+
+  if(sc == NULL)
+  {
+    ss->eof = (load_seq_buffer(src, ss->sb) == eslEOF);
+    return;
+  }
+
+  if(! sc->admitting && sc->next < sc->n)
+  {
+    if(! ss->cached) sc->spare[sc->nspare++] = ss->sb;
+    ss->sb     = sc->buf[sc->next];
+    ss->eof    = sc->eof[sc->next];
+    ss->cached = TRUE;
+  }
+  else
+  {
+    if(ss->cached)
+    {
+      ss->sb     = sc->nspare ? sc->spare[--sc->nspare] : seq_buffer_Create(src, sc->size, sc->budget, sc->sort, sc->abc, sc->numa);
+      ss->cached = FALSE;
+    }
+    if     (sc->admitting)                 seq_source_Tell(src, &pos);
+    else if(sc->next == sc->n && sc->n > 0) seq_source_Seek(src, &sc->resume);   //past the cached prefix
+    ss->eof = (load_seq_buffer(src, ss->sb) == eslEOF);
+
+    if(sc->admitting)
+    {
+      //easel can't say where its source ends, so the empty buffer that can come last always goes in
+      need = (ss->sb->abound[ss->sb->nslices] ? ss->sb->asize : ss->sb->aused) + (size_t) ss->sb->count * (sizeof(HPC_SEQDB_ENTRY) + sizeof(int64_t));
+      if(pos.off >= 0 && sc->bytes + need > sc->cap)
+      {
+        sc->admitting = FALSE;
+        sc->resume    = pos;
+      }
+      else
+      {
+        if(sc->n == sc->alloc)
+        {
+          sc->alloc = sc->alloc ? 2 * sc->alloc : 16;
+          if ((sc->buf = realloc(sc->buf, sizeof(SEQ_BUFFER *) * sc->alloc)) == NULL) goto ERROR;
+          if ((sc->eof = realloc(sc->eof, sizeof(int) * sc->alloc)) == NULL) goto ERROR;
+        }
+        seq_buffer_Shrink(ss->sb);
+        sc->buf[sc->n]   = ss->sb;
+        sc->eof[sc->n++] = ss->eof;
+        sc->bytes       += need;
+        ss->cached       = TRUE;
+      }
+      if(ss->eof) sc->admitting = FALSE;
     }
   }
+  sc->next = ss->eof ? 0 : sc->next + 1;
+  return;
 
-  return hstatus;
+ERROR:
+  p7_Fail("Failed to grow the sequence buffer cache\n");
 }
 
-//go into the hmm buffer and output its contents
-//stop outputting when null model data is found (meaning it's a partial or empty block)
-static int output_hmm_buffer(HMM_BUFFER **hb, int buffer_size, int nquery, OUTPUT_INFO *oi)
+//the control thread waits here for one of the counts to drop to 0. it runs tiles of whatever blocks
+//have some left in the meantime, and only spins once every tile in flight has been taken
+static void ring_wait(SEQ_RING *ring, int *count, int stage, ESL_GETOPTS *go, OUTPUT_INFO *oi)
 {
-  int x;
+  double tw[2];
+  double helped = 0.;
+  int    c, i, t;
+
+  stats_Start(oi->stats, tw);
+  while(1)
+  {
+    #pragma omp atomic read
+    c = *count;
+    if(c == 0) break;
 
-  FILE       *ofp = oi->ofp;
-  FILE       *afp = oi->afp;
-  FILE     *tblfp = oi->tblfp;
-  FILE  *domtblfp = oi->domtblfp;
-  FILE *pfamtblfp = oi->pfamtblfp;
+    for(i = 0, t = -1; i < ring->nts && t < 0; i++)
+      if(ring->ts[i]->mode == SCHED_TILES && (t = tile_Take(ring->ts[i], -1)) >= 0)
+      {
+        double t0 = omp_get_wtime();
+        tile_Run(ring->ts[i], t, go, oi);
+        helped += omp_get_wtime() - t0;
+      }
+    if(t < 0) sched_yield();
+  }
+  #pragma omp flush
 
-  ESL_ALPHABET *abc = oi->abc;
-  ESL_GETOPTS   *go = oi->go;
+  //the tiles it ran count as kernel time, not waiting
+  stats_Span(oi->stats, stage, tw, helped);
+}
 
-  for(x = 0; x < buffer_size; x++)
+//start searching the models in hs against the sequences in ss, without waiting for anything
+//but the plan it reuses. hs and ss stay referenced until the last of its tiles is done
+static void ring_spawn_block(SEQ_RING *ring, HMM_SET *hs, SEQ_SLOT *ss, int nhmm, ESL_GETOPTS *go, OUTPUT_INFO *oi)
+{
+  TILE_SCHED *ts = ring->ts[ring->nblocks % ring->nts];
+
+  ring_wait(ring, &ts->active, ST_WAIT_PLAN, go, oi);
+  ts->refs[0] = &hs->refs;
+  ts->refs[1] = &ss->refs;
+  ts->block   = TRACE_BLOCK | ring->nblocks++;
+
+  if(ts->mode == SCHED_TILES)
   {
-    if(hb[x]->om == NULL)
-      break;
-    else 
-    {
-      if (fprintf(ofp, "Query:       %s  [M=%d]\n", hb[x]->om->name, hb[x]->om->M)  < 0) { fprintf(stderr, "output write failed\n"); exit(0); }
-      if (hb[x]->om->acc) { if (fprintf(ofp, "Accession:   %s\n", hb[x]->om->acc)   < 0) { fprintf(stderr, "output write failed\n"); exit(0); } } 
-      if (hb[x]->om->desc) { if (fprintf(ofp, "Description: %s\n", hb[x]->om->desc) < 0) { fprintf(stderr, "output write failed\n"); exit(0); } }
-
-      p7_tophits_SortBySortkey(hb[x]->th);
-      p7_tophits_Threshold(hb[x]->th, hb[x]->pli);
-      p7_tophits_Targets(ofp, hb[x]->th, hb[x]->pli, oi->textw);
-      if (fprintf(ofp, "\n\n") < 0) { fprintf(stderr, "output write failed\n"); exit(0); }
-
-      p7_tophits_Domains(ofp, hb[x]->th, hb[x]->pli, oi->textw);
-      if (fprintf(ofp, "\n\n") < 0) { fprintf(stderr, "output write failed\n"); exit(0); }
- 
-      if (tblfp)     p7_tophits_TabularTargets (    tblfp, hb[x]->om->name, hb[x]->om->acc, hb[x]->th, hb[x]->pli, (nquery == 1));
-      if (domtblfp)  p7_tophits_TabularDomains ( domtblfp, hb[x]->om->name, hb[x]->om->acc, hb[x]->th, hb[x]->pli, (nquery == 1));
-      if (pfamtblfp) p7_tophits_TabularXfam    (pfamtblfp, hb[x]->om->name, hb[x]->om->acc, hb[x]->th, hb[x]->pli               );
-  
-      p7_pli_Statistics(ofp, hb[x]->pli, NULL);
-      if (fprintf(ofp, "//\n") < 0) { fprintf(stderr, "output write failed\n"); exit(0); }
+    tile_sched_Plan(ts, hs->hb, nhmm, ss->sb);
+    if(oi->stats && oi->stats->trace) trace_Add(oi->stats->trace, TR_SPAWN, omp_get_wtime(), 0., -1, 0, ts->ntiles, 0, ts->block, 0);
+    #pragma omp atomic
+    hs->refs += ts->ntiles;
+    #pragma omp atomic
+    ss->refs += ts->ntiles;
+    tile_sched_Start(ts, go, oi);
+    return;
+  }
+
+  //--sched split units spawn more units as they go, so the whole block counts as one
+  if(oi->stats && oi->stats->trace) trace_Add(oi->stats->trace, TR_SPAWN, omp_get_wtime(), 0., -1, 0, nhmm, 0, ts->block, 0);
+  ts->active = 1;
+  #pragma omp atomic
+  hs->refs += 1;
+  #pragma omp atomic
+  ss->refs += 1;
+  #pragma omp task if(oi->threads > 1)
+  {
+    #pragma omp taskgroup
+    { run_work_block(ts, hs->hb, nhmm, ss->sb, go, oi); }
+    tile_Done(ts);
+    #pragma omp atomic
+    ts->active -= 1;
+  }
+}
+
+//two steps to prepare an hmm buffer for the next pass: output the results it holds (unless this is the
+//first pass), then read the next portion of the hmm file into it, unless there is none. it runs as a task
+//while the search goes on; hs->loading drops back to 0 when it is done
+static void hmm_set_Reload(HMM_SET *hs, int more, P7_HMMFILE *hfp, int *nquery, int nhmm, ESL_GETOPTS *go, OUTPUT_INFO *oi)
+{
+  hs->loading = 1;
+  #pragma omp task if(oi->threads > 1)
+  {
+    double t[2];
+
+    stats_Start(oi->stats, t);
+    if(hs->hb[0]->om != NULL)
+    {
+      output_hmm_buffer(hs->hb, nhmm, *nquery, oi);
+      stats_Stop(oi->stats, ST_OUTPUT, t);
+    }
+    if(more)
+    {
+      hs->hstatus = load_hmm_buffer(hfp, hs->hb, nquery, nhmm, oi->abc, go);
+      stats_Stop(oi->stats, ST_LOAD_HMM, t);
+    }
+    #pragma omp flush
+    #pragma omp atomic write
+    hs->loading = 0;
+  }
+}
+
+//search every model of an hmm file against the database, one pass over the sequences per hmm buffer, and
+//write out the results of the last one. the control thread below runs the whole pipeline
+static void search_models(P7_HMMFILE *hfp, HMM_SET *hset, int hmm_buffer_size, int *nquery, SEQ_RING *ring, SEQ_CACHE *cache, SEQ_SOURCE *src, ESL_GETOPTS *go, OUTPUT_INFO *oi)
+{
+  HMM_SET *cur = hset, *nxt = hset + 1;
+
+  #pragma omp parallel num_threads(oi->threads)
+  {
+    numa_Pin(oi->numa);
 
-      /* Output the results in an MSA (-A option) */
-      if (afp)
+    //this single thread serializes high level control flow decisions: it loads the sequence ring and
+    //spawns the work blocks. I tried a few other arrangements (involving shared loop control variables) but kept getting
+    //threads leaking through loop conditionals, stuck on the wrong barriers, and hanging the program.
+    //nothing here waits for a whole block any more: each slot and hmm buffer counts the tiles still using it,
+    //and only the one about to be reused is waited for
+    #pragma omp single
+    {
+      SEQ_SLOT *ss = ring->slot;
+      int       more_hmms, resident, last, reloading;
+      double    tload[2];
+
+      //prime the pipeline with the first hmm buffer and the first seq buffer
+      stats_Start(oi->stats, tload);
+      cur->hstatus = load_hmm_buffer(hfp, cur->hb, nquery, hmm_buffer_size, oi->abc, go);
+      more_hmms    = (cur->hstatus == eslOK);
+      stats_Stop(oi->stats, ST_LOAD_HMM, tload);
+      seq_cache_Next(cache, src, ss);
+      stats_Stop(oi->stats, ST_LOAD_SEQ, tload);
+
+      //special case when the entire seq db fits in one buffer. Skip reading any more from seq file and search that slot for every hmm buffer.
+      //remember we're in the single control thread scope so this is not a shared control variable
+      resident = ss->eof;
+
+      //one pass through the seq db per hmm buffer. the last, partial hmm buffer is no different
+      while(cur->hb[0]->om != NULL)
       {
-        ESL_MSA *msa = NULL;
+        reloading = FALSE;
+        do
+        {
+          ring_spawn_block(ring, cur, ss, hmm_buffer_size, go, oi);
+          last = ss->eof;
 
-        if (p7_tophits_Alignment(hb[x]->th, abc, NULL, NULL, 0, p7_ALL_CONSENSUS_COLS, &msa) == eslOK)
+          //the other hmm buffer is written out and refilled as soon as the last tile searching it is done
+          if(! reloading)
+          {
+            int busy;
+            #pragma omp atomic read
+            busy = nxt->refs;
+            if(busy == 0)
+            {
+              hmm_set_Reload(nxt, more_hmms, hfp, nquery, hmm_buffer_size, go, oi);
+              reloading = TRUE;
+            }
+          }
+
+          //refill the next slot once the blocks that read it are done. after the end of the seq db this
+          //loads the first block of the next pass. with --seq_cache a refill may just point it at a cached buffer
+          if(! resident)
+          {
+            ss = ring->slot + (ss - ring->slot + 1) % ring->nslots;
+            ring_wait(ring, &ss->refs, ST_WAIT_SLOT, go, oi);
+            stats_Start(oi->stats, tload);
+            seq_cache_Next(cache, src, ss);
+            stats_Stop(oi->stats, ST_LOAD_SEQ, tload);
+          }
+        } while(! last);
+
+        if(! reloading)
         {
-          if (oi->textw > 0) esl_msafile_Write(afp, msa, eslMSAFILE_STOCKHOLM);
-          else               esl_msafile_Write(afp, msa, eslMSAFILE_PFAM);
-          if (fprintf(ofp, "# Alignment of %d hits satisfying inclusion thresholds saved to: %s\n", msa->nseq, esl_opt_GetString(go, "-A")) < 0)
-            { fprintf(stderr, "output write failed\n"); exit(0); }
+          ring_wait(ring, &nxt->refs, ST_WAIT_HMM, go, oi);
+          hmm_set_Reload(nxt, more_hmms, hfp, nquery, hmm_buffer_size, go, oi);
         }
-        else
-          if (fprintf(ofp, "# No hits satisfy inclusion thresholds; no alignment saved\n") < 0) { fprintf(stderr, "output write failed\n"); exit(1); }
 
-        esl_msa_Destroy(msa);
+        //the next pass needs its models. whatever is left of this one keeps running meanwhile
+        ring_wait(ring, &nxt->loading, ST_WAIT_MODELS, go, oi);
+        more_hmms = more_hmms && nxt->hstatus == eslOK;
+
+        HMM_SET *temp = cur;
+        cur = nxt;
+        nxt = temp;
       }
+    } //end single control thread
+  } //end parallel region
+
+  //finally, write the output for the last hmm buffer searched
+  double tout[2];
+  stats_Start(oi->stats, tout);
+  output_hmm_buffer(nxt->hb, hmm_buffer_size, *nquery, oi);
+  stats_Stop(oi->stats, ST_OUTPUT, tout);
+}
 
-      p7_pipeline_Destroy(hb[x]->pli);
-      p7_tophits_Destroy (hb[x]->th );
-      p7_oprofile_Destroy(hb[x]->om );
-      p7_bg_Destroy      (hb[x]->bg );
+//--daemon: the database stays in memory (in a --seq_cache with no limit, unless --seq_cache gives one, or
+//mapped) and so does the thread pool, between searches. a client connects to the UNIX socket and sends
+//   SEARCH <n>\n   and then <n> bytes of an HMM file
+//   QUIT\n         to stop the daemon
+//and a search sends back each output as a line "<name> <n>\n" and <n> bytes: OUT, the main output, then
+//TBL and DOMTBL, the tables; then END\n. a request that fails gets ERR <why>\n instead.
+//searches run one at a time, each on every thread, with the options the daemon was started with.
+//a request has DAEMON_TIMEOUT seconds to arrive in full, and each write of the reply as long, so a client
+//that stalls can't hold up the ones queued behind it
+#define DAEMON_MAXREQ  (1 << 30)
+#define DAEMON_TIMEOUT 60
 
-      hb[x]->om = NULL;
-    }
+static int daemon_WriteAll(int fd, const char *buf, size_t n)
+{
+  ssize_t w;
+
+  while(n > 0)
+  {
+    if((w = write(fd, buf, n)) < 0) { if(errno == EINTR) continue; return eslFAIL; }
+    buf += w;
+    n   -= w;
+  }
+  return eslOK;
+}
+
+//<n> bytes by omp_get_wtime() <deadline>. eslEOF if the client hung up, eslFAIL with errno ETIMEDOUT if it was too slow
+static int daemon_ReadAll(int fd, char *buf, size_t n, double deadline)
+{
+  struct pollfd pfd;
+  ssize_t       r;
+  double        left;
+
+  pfd.fd     = fd;
+  pfd.events = POLLIN;
+  while(n > 0)
+  {
+    if((left = deadline - omp_get_wtime()) <= 0.) { errno = ETIMEDOUT; return eslFAIL; }
+    if((r = poll(&pfd, 1, (int) (left * 1000.) + 1)) < 0) { if(errno == EINTR) continue; return eslFAIL; }
+    if(r == 0) continue;   //the deadline is checked again at the top
+    if((r = read(fd, buf, n)) < 0) { if(errno == EINTR) continue; return eslFAIL; }
+    if(r == 0) return eslEOF;
+    buf += r;
+    n   -= r;
   }
+  return eslOK;
+}
+
+//a request line, without its newline. requests are a line or two, so a byte at a time is fine
+static int daemon_ReadLine(int fd, char *line, int max, double deadline)
+{
+  int n = 0;
+  int status;
+
+  while(n < max - 1)
+  {
+    if((status = daemon_ReadAll(fd, line + n, 1, deadline)) != eslOK) return status;
+    if(line[n] == '\n') { line[n] = '\0'; return eslOK; }
+    n++;
+  }
+  return eslEFORMAT;
+}
 
+static void daemon_Error(int fd, const char *fmt, ...)
+{
+  char    msg[eslERRBUFSIZE + 64];
+  char   *c;
+  int     n;
+  va_list ap;
+
+  va_start(ap, fmt);
+  n = vsnprintf(msg + 4, sizeof(msg) - 5, fmt, ap);
+  va_end(ap);
+  n = ESL_MIN(n, (int) sizeof(msg) - 6) + 4;
+  memcpy(msg, "ERR ", 4);
+  for(c = msg + 4; c < msg + n; c++) if(*c == '\n') *c = ' ';   //it has to stay one line
+  msg[n++] = '\n';
+  daemon_WriteAll(fd, msg, n);
+}
+
+static int daemon_Section(int fd, const char *name, const char *buf, size_t n)
+{
+  char head[64];
+  int  len = snprintf(head, sizeof(head), "%s %zu\n", name, n);
+
+  if(daemon_WriteAll(fd, head, len) != eslOK || daemon_WriteAll(fd, buf, n) != eslOK) return eslFAIL;
   return eslOK;
 }
 
-static int thread_kernel(HMM_BUFFER *hb, ESL_SQ **sbb, int start, int end, ESL_GETOPTS *go, OUTPUT_INFO *oi)
+//one SEARCH: the outputs go to memory streams, as if the models had come from <hmmfile>, and then to the client
+static void daemon_Search(int fd, char *text, int n, HMM_SET *hset, int hmm_buffer_size, SEQ_RING *ring, SEQ_CACHE *cache,
+                          SEQ_SOURCE *src, char *dbfile, ESL_GETOPTS *go, OUTPUT_INFO *oi)
+{
+  P7_HMMFILE   *hfp     = NULL;
+  P7_HMM       *hmm     = NULL;
+  ESL_ALPHABET *abc     = oi->abc;
+  char         *name[3] = { "OUT", "TBL", "DOMTBL" };
+  char         *buf[3]  = { NULL, NULL, NULL };
+  size_t        len[3]  = { 0, 0, 0 };
+  FILE         *fp[3];
+  int           nquery  = 0;
+  int           nmodels = 0;
+  int           status, s;
+
+  //read every model once before searching any: load_hmm_buffer treats a bad one as fatal
+  if(p7_hmmfile_OpenBuffer(text, n, &hfp) != eslOK) { daemon_Error(fd, "not an HMM file"); return; }
+  while((status = p7_hmmfile_Read(hfp, &abc, &hmm)) == eslOK)
+  {
+    nmodels++;
+    p7_hmm_Destroy(hmm);
+    hmm = NULL;
+  }
+  if     (status == eslEINCOMPAT) daemon_Error(fd, "model %d is not %s, as the database is", nmodels + 1, esl_abc_DecodeType(oi->abc->type));
+  else if(status == eslEFORMAT)   daemon_Error(fd, "bad HMM file: %s", hfp->errbuf);
+  else if(status != eslEOF)       daemon_Error(fd, "unexpected error %d reading the HMM file", status);
+  else if(nmodels == 0)           daemon_Error(fd, "no models");
+  p7_hmmfile_Close(hfp);
+  if(status != eslEOF || nmodels == 0) return;
+  if(p7_hmmfile_OpenBuffer(text, n, &hfp) != eslOK) p7_Fail("Reopening the hmm buffer shouldn't have failed.\n");
+
+  for(s = 0; s < 3; s++)
+    if((fp[s] = open_memstream(&buf[s], &len[s])) == NULL) p7_Fail("Failed to open an output buffer\n");
+  oi->ofp      = fp[0];
+  oi->tblfp    = fp[1];
+  oi->domtblfp = fp[2];
+
+  output_header(oi->ofp, go, "-", dbfile, NULL);
+  seq_cache_Rewind(cache, src);
+  search_models(hfp, hset, hmm_buffer_size, &nquery, ring, cache, src, go, oi);
+  p7_tophits_TabularTail(oi->tblfp,    "hmmsearch", p7_SEARCH_SEQS, "-", dbfile, go);
+  p7_tophits_TabularTail(oi->domtblfp, "hmmsearch", p7_SEARCH_SEQS, "-", dbfile, go);
+  if (fprintf(oi->ofp, "[ok]\n") < 0) p7_Fail("Failed to write to an output buffer\n");
+
+  oi->ofp = oi->tblfp = oi->domtblfp = NULL;
+  for(s = 0; s < 3; s++) fclose(fp[s]);
+  p7_hmmfile_Close(hfp);
+
+  //a client that went away mid-reply loses it; that is all
+  for(s = 0; s < 3; s++)
+    if(daemon_Section(fd, name[s], buf[s], len[s]) != eslOK) break;
+  if(s == 3) daemon_WriteAll(fd, "END\n", 4);
+  for(s = 0; s < 3; s++) free(buf[s]);
+}
+
+static void daemon_Serve(const char *path, HMM_SET *hset, int hmm_buffer_size, SEQ_RING *ring, SEQ_CACHE *cache, SEQ_SOURCE *src,
+                         char *dbfile, ESL_GETOPTS *go, OUTPUT_INFO *oi)
+{
+  struct sockaddr_un addr;
+  struct stat        st;
+  char               line[128];
+  char              *text = NULL;
+  struct timeval     tv;
+  long long          n;
+  double             deadline;
+  int                sfd, fd;
+  int                quit = FALSE;
+  int                status;
+
+  if(strlen(path) >= sizeof(addr.sun_path)) p7_Fail("--daemon: socket path %s is too long\n", path);
+
+  //read the database now, so the first client doesn't wait for it. what doesn't fit a --seq_cache limit is
+  //read again by every search
+  if(cache)
+  {
+    #pragma omp parallel num_threads(oi->threads)
+    {
+      numa_Pin(oi->numa);
+      #pragma omp single
+      {
+        do seq_cache_Next(cache, src, ring->slot); while(! ring->slot->eof);
+      }
+    }
+  }
+
+  signal(SIGPIPE, SIG_IGN);   //a client that hangs up early must not take the daemon with it
+  if((sfd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) p7_Fail("--daemon: failed to create a socket: %s\n", strerror(errno));
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+  if(stat(path, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(path);   //left by a daemon that was killed
+  if(bind(sfd, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(sfd, 16) < 0)
+    p7_Fail("--daemon: failed to listen on %s: %s\n", path, strerror(errno));
+
+  if(cache) fprintf(stderr, "# hpc_hmmsearch daemon: %d sequence buffers, %.0f MB, in memory%s; listening on %s\n", cache->n, cache->bytes / 1048576.,
+                    cache->n && cache->eof[cache->n - 1] ? "" : " (the rest is read for each search)", path);
+  else      fprintf(stderr, "# hpc_hmmsearch daemon: database mapped; listening on %s\n", path);
+
+  while(! quit)
+  {
+    if((fd = accept(sfd, NULL, NULL)) < 0)
+    {
+      if(errno == EINTR || errno == ECONNABORTED) continue;
+      p7_Fail("--daemon: accept failed: %s\n", strerror(errno));
+    }
+    tv.tv_sec  = DAEMON_TIMEOUT;
+    tv.tv_usec = 0;
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));   //a reply write that blocks this long fails instead
+    deadline = omp_get_wtime() + DAEMON_TIMEOUT;
+
+    if((status = daemon_ReadLine(fd, line, sizeof(line), deadline)) == eslOK)
+    {
+      if(strcmp(line, "QUIT") == 0)
+      {
+        daemon_WriteAll(fd, "END\n", 4);
+        quit = TRUE;
+      }
+      else if(sscanf(line, "SEARCH %lld", &n) == 1 && n > 0 && n <= DAEMON_MAXREQ)
+      {
+        if((text = malloc(n)) == NULL) daemon_Error(fd, "can't allocate %lld bytes", n);
+        else if((status = daemon_ReadAll(fd, text, n, deadline)) == eslOK) daemon_Search(fd, text, (int) n, hset, hmm_buffer_size, ring, cache, src, dbfile, go, oi);
+        free(text);
+        text = NULL;
+      }
+      else daemon_Error(fd, "bad request: %s", line);
+    }
+    else if(status == eslEFORMAT) daemon_Error(fd, "request line too long");
+    if(status == eslFAIL && errno == ETIMEDOUT) daemon_Error(fd, "request not received within %d seconds", DAEMON_TIMEOUT);
+    close(fd);
+  }
+  close(sfd);
+  unlink(path);
+}
+
+//--bench_sched: run the first work block under each scheduler and report how long threads sat idle.
+//tail is the time from the first thread running out of work to the end of the block
+static void benchmark_sched(HMM_BUFFER **hb, int nhmm, SEQ_BUFFER *sb, ESL_GETOPTS *go, OUTPUT_INFO *oi, FILE *ofp)
+{
+  TILE_SCHED *ts      = oi->sched;
+  char       *name[2] = { "tiles", "split" };
+  int         nrep    = 3;
+  int         mode, rep, t, nmodel;
+
+  if ((ts->busy = malloc(sizeof(double) * oi->threads)) == NULL) goto ERROR;
+  if ((ts->done = malloc(sizeof(double) * oi->threads)) == NULL) goto ERROR;
+
+  for(nmodel = 0, t = 0; t < nhmm; t++) nmodel += (hb[t]->om != NULL);
+  if (fprintf(ofp, "# %d threads, %d models x %d sequences (%lld residues), best of %d\n", oi->threads, nmodel, sb->count, (long long) sb->res_sum[sb->count], nrep) < 0) goto WERROR;
+  if (fprintf(ofp, "# %-10s %10s %10s %8s %10s %8s\n", "scheduler", "wall s", "busy s", "idle %", "tail s", "tiles") < 0) goto WERROR;
+
+  for(mode = SCHED_TILES; mode <= SCHED_SPLIT; mode++)
+  {
+    double best_wall = -1., best_busy = 0., best_tail = 0.;
+
+    ts->mode = mode;
+    for(rep = 0; rep < nrep; rep++)
+    {
+      double t0, wall, busy = 0., first_idle;
+
+      for(t = 0; t < oi->threads; t++) ts->busy[t] = ts->done[t] = 0.;
+      t0 = omp_get_wtime();
+      #pragma omp parallel num_threads(oi->threads)
+      {
+        #pragma omp single
+        {
+          #pragma omp taskgroup
+          { run_work_block(ts, hb, nhmm, sb, go, oi); }
+        }
+      }
+      wall = omp_get_wtime() - t0;
+
+      first_idle = wall;
+      for(t = 0; t < oi->threads; t++)
+      {
+        busy      += ts->busy[t];
+        first_idle = ESL_MIN(first_idle, ts->done[t] > 0. ? ts->done[t] - t0 : 0.);
+      }
+      if(best_wall < 0. || wall < best_wall) { best_wall = wall; best_busy = busy; best_tail = wall - first_idle; }
+    }
+
+    if (fprintf(ofp, "  %-10s %10.3f %10.3f %8.1f %10.3f %8d\n", name[mode], best_wall, best_busy,
+                100. * (1. - best_busy / (best_wall * oi->threads)), best_tail, mode == SCHED_TILES ? ts->ntiles : nmodel) < 0) goto WERROR;
+  }
+
+  free(ts->busy); ts->busy = NULL;
+  free(ts->done); ts->done = NULL;
+  return;
+
+ERROR:
+  p7_Fail("Failed to allocate scheduler benchmark\n");
+WERROR:
+  p7_Fail("scheduler benchmark failed\n");
+}
+
+//this thread's node's copy of the profile, made on first use there so that its pages are local. it has to
+//be a deep copy: p7_oprofile_Clone would share the score vectors, which live on the node that built the model
+static P7_OPROFILE *numa_Profile(HMM_BUFFER *hb, NUMA_INFO *numa)
+{
+  int          k  = numa->node[omp_get_thread_num()];
+  P7_OPROFILE *om = NULL;
+
+  if(hb->om_node == NULL) return hb->om;
+  #pragma omp critical (numa_profile)
+  {
+    if(hb->om_node[k] == NULL && (hb->om_node[k] = p7_oprofile_Copy(hb->om)) == NULL)
+      p7_Fail("Failed to copy a profile to numa node %d\n", numa->id[k]);
+    om = hb->om_node[k];
+  }
+  return om;
+}
+
+static int thread_kernel(HMM_BUFFER *hb, SEQ_BUFFER *sb, int start, int end, ESL_GETOPTS *go, OUTPUT_INFO *oi)
 {
-  if(hb->om != NULL && sbb[0]->n > 0) //if either the model or the seq is empty then just skip it
+  double t0 = oi->sched->busy ? omp_get_wtime() : 0.;
+  double ts[2];
+  int    outer = (oi->stats && oi->pool[omp_get_thread_num()].depth == 0);   //a unit run inside another isn't timed twice
+  TRACE   *tr  = oi->stats ? oi->stats->trace : NULL;
+  uint64_t id  = 0, parent = 0;
+  double   tt0 = 0.;
+
+  if(outer) stats_Start(oi->stats, ts);
+  if(tr)
+  {
+    id     = trace_Id(tr);
+    parent = tr->pending[omp_get_thread_num()];
+    tt0    = omp_get_wtime();
+  }
+
+  if(hb->om != NULL && sb->count > 0) //if either the model or the seq is empty then just skip it
   {
-    //make working copies of all needed data structures for a work unit
-    P7_OPROFILE *om  = p7_oprofile_Copy(hb->om);
-    P7_TOPHITS  *th  = p7_tophits_Create();
-    P7_BG       *bg  = p7_bg_Create(oi->abc);
-    P7_PIPELINE *pli = p7_pipeline_Create(go, om->M, 100, FALSE, p7_SEARCH_SEQS);
-                       p7_pli_NewModel(pli, om, bg);
+    //this thread's reusable working state, set up for this model. the profile itself is shared
+    WORK_STATE  *ws  = work_state_Get(oi->pool, oi->numa ? numa_Profile(hb, oi->numa) : hb->om, go, oi->abc);
+    P7_OPROFILE *om  = &ws->om;
+    P7_TOPHITS  *th  = ws->th;
+    P7_BG       *bg  = ws->bg;
+    P7_PIPELINE *pli = ws->pli;
+#ifdef HAVE_MSV_BATCH
+    MSV_BATCH   *mb  = (ws->mb && msv_batch_Prepare(ws->mb, om) == eslOK) ? ws->mb : NULL;
+#endif
+
+    ESL_SQ view;   //of the current target; only the ones the first stage passes get one
+    memset(&view, 0, sizeof(ESL_SQ));
+    view.abc = oi->abc;
 
     int x; 
     for(x = start; x < end; x++)
@@ -763,47 +5463,83 @@ static int thread_kernel(HMM_BUFFER *hb, ESL_SQ **sbb, int start, int end, ESL_G
       //when fewer tasks remain than available threads then we are losing time.
       //we can take a remaining task and divert some of its sequences into a new task.
       //this 8 is arbitrary right now. future work to measure new task overhead and set accordingly
-      if((work_counter <= (oi->threads)) && (x < (end - 8)))
+      //the split is by residues, not by sequence count
+      //(only with --sched split; tiles are sized before the block starts)
+      if(oi->sched->mode == SCHED_SPLIT && (work_counter <= (oi->threads)) && (x < (end - 8)))
       {
         #pragma omp atomic
         work_counter++;
+        if(oi->stats) oi->stats->splits[omp_get_thread_num()]++;
 
         int tx = x;
-        x = x + ((end - x) >> 1);
+        x = split_point(sb, x, end);
         
         #pragma omp task
         {
-          thread_kernel(hb, sbb, tx, x, go, oi);
+          if(tr) tr->pending[omp_get_thread_num()] = id;
+          thread_kernel(hb, sb, tx, x, go, oi);
         }
       }
 
-
-      if(sbb[x]->n > 0)
+      int64_t n = sb->rec[x].len;
+      if(n > 0)
       {
-        p7_pli_NewSeq(pli, sbb[x]);
-        p7_bg_SetLength(bg, sbb[x]->n);
-        p7_oprofile_ReconfigLength(om, sbb[x]->n);
-        p7_Pipeline(pli, om, bg, sbb[x], NULL, th);
+        view.n = n;               //all the pipeline's target count needs
+        p7_pli_NewSeq(pli, &view);
+#ifdef HAVE_MSV_BATCH
+        //decide the first stage for the next window of targets at once. a target that fails it
+        //would have left p7_Pipeline right after MSV with nothing recorded, so it is done here
+        if(mb)
+        {
+          if(x < mb->lo || x >= mb->hi)
+          {
+            mb->lo = x;
+            mb->hi = ESL_MIN(end, x + MSV_WINDOW);
+            msv_batch_Run(mb, om, bg, sb, mb->lo, mb->hi - mb->lo, pli->F1);
+          }
+          if(! mb->pass[x - mb->lo]) continue;
+        }
+#endif
+        seq_View(sb, x, &view);
+        p7_bg_SetLength(bg, n);
+        //domain definition restores the length it was given, so om->L is still the previous
+        //sequence's length here. in a length sorted buffer most reconfigurations are skipped
+        if(om->L != n) p7_oprofile_ReconfigLength(om, n);
+        uint64_t nhit = th->N;
+
+        p7_Pipeline(pli, om, bg, &view, NULL, th);
+        if(th->N > nhit)
+        {
+          P7_HIT *hit = &th->unsrt[th->N - 1];
+
+          if     (hb->topk && ! topk_Add(hb->topk, hit->sortkey)) hit_DropDomains(hit);
+          else if(oi->noali)                                      hit_StripAlignments(hit);
+        }
         p7_pipeline_Reuse(pli);
       }
     }
 
-    //take the results of this work unit and merge them with the master results in the hmm buffer
-    #pragma omp critical
-    {
-      p7_tophits_Merge(hb->th, th);
-      p7_pipeline_Merge(hb->pli, pli);
-    }
+    //leave the results of this work unit in this thread's slot of the hmm buffer
+    hit_accumulate(hb, omp_get_thread_num(), th, pli);
 
-    p7_oprofile_Destroy(om);
-    p7_tophits_Destroy(th);
-    p7_pipeline_Destroy(pli);
-    p7_bg_Destroy(bg);
+    work_state_Put(oi->pool, ws);
+  }
+
+  if(oi->sched->busy)
+  {
+    double t1 = omp_get_wtime();
+    oi->sched->busy[omp_get_thread_num()] += t1 - t0;
+    oi->sched->done[omp_get_thread_num()]  = ESL_MAX(oi->sched->done[omp_get_thread_num()], t1);
   }
 
-  #pragma omp atomic 
-  work_counter--;
+  if(oi->sched->mode == SCHED_SPLIT)
+  {
+    #pragma omp atomic 
+    work_counter--;
+  }
 
+  if(outer) stats_Stop(oi->stats, ST_KERNEL, ts);
+  if(tr)    trace_Kernel(tr, hb, sb, start, end, tt0, id, parent);
   return eslOK;
 }
 
@@ -0,0 +1,181 @@
+/* hpc_makeseqdb: convert a sequence database into the pre-digitized, mmap-able
+ * format that hpc_hmmsearch can search without re-parsing text on every pass.
+ *
+ * Build it next to hpc_hmmsearch, with the same compile and link lines (no openmp needed):
+cc -O3 -fPIC -DHAVE_CONFIG_H -I../easel -I../libdivsufsort -I../easel -I. -I. -o hpc_makeseqdb.o -c hpc_makeseqdb.c
+cc -O3 -fPIC -DHAVE_CONFIG_H -L../easel -L./impl_sse -L../libdivsufsort -L. -o hpc_makeseqdb hpc_makeseqdb.o -lhmmer -leasel -ldivsufsort -lm
+ */
+
+#include "p7_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_getopts.h"
+#include "esl_sq.h"
+#include "esl_sqio.h"
+
+#include "hmmer.h"
+
+#include "hpc_seqdb.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type         default  env  range     toggles   reqs   incomp              help                                                      docgroup*/
+  { "-h",           eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL,  NULL,            "show brief help on version and usage",                         1 },
+  { "--amino",      eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL, "--dna,--rna",    "<seqfile> contains protein sequences",                         1 },
+  { "--dna",        eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL, "--amino,--rna",  "<seqfile> contains DNA sequences",                             1 },
+  { "--rna",        eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL, "--amino,--dna",  "<seqfile> contains RNA sequences",                             1 },
+  { "--informat",   eslARG_STRING,  NULL, NULL, NULL,    NULL,  NULL,  NULL,            "assert <seqfile> is in format <s>: no autodetection",          1 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+
+static char usage[]  = "[options] <seqfile> <seqdb>";
+static char banner[] = "convert a sequence file to a pre-digitized database for hpc_hmmsearch";
+
+//strings go to their own scratch file while residues stream into the output,
+//because the string section can only be placed once the residue section's size is known
+static uint64_t write_string(FILE *fp, const char *s, uint64_t *str_size)
+{
+  uint64_t off = *str_size;
+  size_t   n   = strlen(s) + 1;
+
+  if (fwrite(s, 1, n, fp) != n) p7_Fail("Failed to write string section scratch file\n");
+  *str_size += n;
+  return off;
+}
+
+//copy the whole of a scratch file to the output at its current position
+static void append_scratch(FILE *ofp, FILE *sfp)
+{
+  char   buf[65536];
+  size_t n;
+
+  rewind(sfp);
+  while ((n = fread(buf, 1, sizeof(buf), sfp)) > 0)
+    if (fwrite(buf, 1, n, ofp) != n) p7_Fail("Failed to write sequence database\n");
+  if (ferror(sfp)) p7_Fail("Failed to read back scratch file\n");
+}
+
+static void pad_to(FILE *ofp, uint64_t off)
+{
+  static const char zero[8] = { 0 };
+  uint64_t          pos     = (uint64_t) ftello(ofp);
+
+  if (off > pos && fwrite(zero, 1, off - pos, ofp) != off - pos) p7_Fail("Failed to write sequence database\n");
+}
+
+int main(int argc, char **argv)
+{
+  ESL_GETOPTS      *go      = esl_getopts_Create(options);
+  ESL_ALPHABET     *abc     = NULL;
+  ESL_SQFILE       *sqfp    = NULL;
+  ESL_SQ           *sq      = NULL;
+  FILE             *ofp     = NULL;
+  FILE             *idxfp   = NULL;
+  FILE             *strfp   = NULL;
+  HPC_SEQDB_HEADER  hdr;
+  HPC_SEQDB_ENTRY   e;
+  ESL_DSQ           sentinel = eslDSQ_SENTINEL;
+  int               infmt    = eslSQFILE_UNKNOWN;
+  int               alphatype = eslUNKNOWN;
+  int               status;
+
+  if (esl_opt_ProcessCmdline(go, argc, argv) != eslOK || esl_opt_VerifyConfig(go) != eslOK)
+  {
+    printf("Failed to parse command line: %s\n", go->errbuf);
+    esl_usage(stdout, argv[0], usage);
+    exit(1);
+  }
+  if (esl_opt_GetBoolean(go, "-h") == TRUE)
+  {
+    p7_banner(stdout, argv[0], banner);
+    esl_usage(stdout, argv[0], usage);
+    puts("\nOptions:");
+    esl_opt_DisplayHelp(stdout, go, 1, 2, 80);
+    exit(0);
+  }
+  if (esl_opt_ArgNumber(go) != 2) { puts("Incorrect number of command line arguments."); esl_usage(stdout, argv[0], usage); exit(1); }
+
+  if (esl_opt_IsOn(go, "--informat"))
+  {
+    infmt = esl_sqio_EncodeFormat(esl_opt_GetString(go, "--informat"));
+    if (infmt == eslSQFILE_UNKNOWN) p7_Fail("%s is not a recognized sequence file format\n", esl_opt_GetString(go, "--informat"));
+  }
+
+  status = esl_sqfile_Open(esl_opt_GetArg(go, 1), infmt, NULL, &sqfp);
+  if      (status == eslENOTFOUND) p7_Fail("Failed to open sequence file %s for reading\n", esl_opt_GetArg(go, 1));
+  else if (status == eslEFORMAT)   p7_Fail("Sequence file %s is empty or misformatted\n",   esl_opt_GetArg(go, 1));
+  else if (status != eslOK)        p7_Fail("Unexpected error %d opening sequence file %s\n", status, esl_opt_GetArg(go, 1));
+
+  if      (esl_opt_GetBoolean(go, "--amino")) alphatype = eslAMINO;
+  else if (esl_opt_GetBoolean(go, "--dna"))   alphatype = eslDNA;
+  else if (esl_opt_GetBoolean(go, "--rna"))   alphatype = eslRNA;
+  else if (esl_sqfile_GuessAlphabet(sqfp, &alphatype) != eslOK)
+    p7_Fail("Couldn't guess the alphabet of %s; use --amino, --dna or --rna\n", esl_opt_GetArg(go, 1));
+
+  abc = esl_alphabet_Create(alphatype);
+  esl_sqfile_SetDigital(sqfp, abc);
+  sq  = esl_sq_CreateDigital(abc);
+
+  if ((ofp   = fopen(esl_opt_GetArg(go, 2), "wb")) == NULL) p7_Fail("Failed to open %s for writing\n", esl_opt_GetArg(go, 2));
+  if ((idxfp = tmpfile()) == NULL || (strfp = tmpfile()) == NULL) p7_Fail("Failed to create scratch files\n");
+
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, HPC_SEQDB_MAGIC, HPC_SEQDB_MAGICLEN);
+  hdr.version    = HPC_SEQDB_VERSION;
+  hdr.abc_type   = abc->type;
+  hdr.res_offset = HPC_SEQDB_ALIGN(sizeof(HPC_SEQDB_HEADER));
+
+  //placeholder header, rewritten once the section sizes are known
+  if (fwrite(&hdr, sizeof(hdr), 1, ofp) != 1) p7_Fail("Failed to write sequence database\n");
+  pad_to(ofp, hdr.res_offset);
+
+  //the residue section opens with the sentinel that leads the first sequence
+  if (fwrite(&sentinel, 1, 1, ofp) != 1) p7_Fail("Failed to write sequence database\n");
+  hdr.res_size = 1;
+
+  while ((status = esl_sqio_Read(sqfp, sq)) == eslOK)
+  {
+    e.dsq_off  = hdr.res_size - 1;
+    e.len      = sq->n;
+    e.name_off = write_string(strfp, sq->name, &hdr.str_size);
+    e.acc_off  = write_string(strfp, sq->acc,  &hdr.str_size);
+    e.desc_off = write_string(strfp, sq->desc, &hdr.str_size);
+    if (fwrite(&e, sizeof(e), 1, idxfp) != 1) p7_Fail("Failed to write index scratch file\n");
+
+    //dsq[1..n] followed by the sentinel that also leads the next sequence
+    if (fwrite(sq->dsq + 1, 1, sq->n + 1, ofp) != (size_t) sq->n + 1) p7_Fail("Failed to write sequence database\n");
+    hdr.res_size += sq->n + 1;
+    hdr.nres     += sq->n;
+    hdr.nseq++;
+    esl_sq_Reuse(sq);
+  }
+  if      (status == eslEFORMAT) p7_Fail("Parse failed (sequence file %s):\n%s\n", sqfp->filename, esl_sqfile_GetErrorBuf(sqfp));
+  else if (status != eslEOF)     p7_Fail("Unexpected error %d reading sequence file %s\n", status, sqfp->filename);
+
+  hdr.idx_offset = HPC_SEQDB_ALIGN(hdr.res_offset + hdr.res_size);
+  pad_to(ofp, hdr.idx_offset);
+  append_scratch(ofp, idxfp);
+
+  hdr.str_offset = HPC_SEQDB_ALIGN(hdr.idx_offset + hdr.nseq * sizeof(HPC_SEQDB_ENTRY));
+  pad_to(ofp, hdr.str_offset);
+  append_scratch(ofp, strfp);
+
+  rewind(ofp);
+  if (fwrite(&hdr, sizeof(hdr), 1, ofp) != 1) p7_Fail("Failed to write sequence database\n");
+  if (fclose(ofp) != 0)                      p7_Fail("Failed to close %s\n", esl_opt_GetArg(go, 2));
+
+  printf("%s: %llu sequences, %llu residues (%s)\n", esl_opt_GetArg(go, 2),
+         (unsigned long long) hdr.nseq, (unsigned long long) hdr.nres, esl_abc_DecodeType(abc->type));
+
+  fclose(idxfp);
+  fclose(strfp);
+  esl_sq_Destroy(sq);
+  esl_sqfile_Close(sqfp);
+  esl_alphabet_Destroy(abc);
+  esl_getopts_Destroy(go);
+  return 0;
+}
@@ -0,0 +1,49 @@
+/* hpc_seqdb.h : on-disk layout of the pre-digitized target sequence database
+ *
+ * Written by hpc_makeseqdb, read by hpc_hmmsearch through mmap().
+ * The file is used in place: residues are stored already digitized and
+ * each sequence is framed by eslDSQ_SENTINEL bytes exactly like an ESL_DSQ,
+ * so a sequence in the mapping can be handed to the pipeline without copying.
+ * Neighbouring sequences share a sentinel.
+ *
+ *   [header][residue section][index][string section]
+ *
+ * Every section starts on an 8 byte boundary. Integers are in the byte order
+ * of the machine that wrote the file. The magic is a plain string and reads the
+ * same in either order; the version field is the byte order check, since on a
+ * machine of the other order it reads byte-swapped.
+ */
+#ifndef HPC_SEQDB_INCLUDED
+#define HPC_SEQDB_INCLUDED
+
+#include <stdint.h>
+
+#define HPC_SEQDB_MAGIC     "HPCSQDB1"
+#define HPC_SEQDB_MAGICLEN  8
+#define HPC_SEQDB_VERSION   1
+#define HPC_SEQDB_ALIGN(x)  (((x) + 7) & ~((uint64_t) 7))
+
+typedef struct
+{
+  char     magic[HPC_SEQDB_MAGICLEN];
+  uint32_t version;
+  uint32_t abc_type;       /* eslAMINO, eslDNA or eslRNA                                  */
+  uint64_t nseq;           /* number of sequences                                         */
+  uint64_t nres;           /* total residues, not counting sentinels                      */
+  uint64_t res_offset;     /* file offset of the residue section                          */
+  uint64_t res_size;       /* nres + nseq + 1 bytes: residues plus shared sentinels       */
+  uint64_t idx_offset;     /* file offset of nseq HPC_SEQDB_ENTRY records                 */
+  uint64_t str_offset;     /* file offset of the NUL terminated name/acc/desc strings     */
+  uint64_t str_size;
+} HPC_SEQDB_HEADER;
+
+typedef struct
+{
+  uint64_t dsq_off;        /* residue section offset of the leading sentinel; residues follow at 1..len */
+  uint64_t len;            /* residue count                                                             */
+  uint64_t name_off;       /* string section offsets                                                    */
+  uint64_t acc_off;
+  uint64_t desc_off;
+} HPC_SEQDB_ENTRY;
+
+#endif /*HPC_SEQDB_INCLUDED*/